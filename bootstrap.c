@@ -0,0 +1,340 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Bootstrap confidence intervals.
+//
+// The real times of a command are resampled (with replacement)
+// conf->bootstrap times. Rather than materialising and sorting each
+// resample, we draw how many times each (sorted) sample is picked, so that
+// the mean and every quantile of a resample come from a single pass over
+// those counts. Resamples are independent, so they are divided between as
+// many threads as there are CPUs online.
+//
+// Intervals are either the percentiles of the resampled statistics, or
+// bias-corrected and accelerated (BCa; Efron 1987), where the bias comes from
+// how many resampled statistics fall below the sample's, and the acceleration
+// from the skewness of the jackknife (leave-one-out) statistics.
+//
+
+#include "Config.h"
+
+#include <err.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef MT_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "multitime.h"
+#include "bootstrap.h"
+#include "outlier.h"
+#include "stats.h"
+
+// The work of one thread: resamples [from, to) of the n sorted values in xs.
+
+typedef struct {
+    const int64_t *xs;
+    int n;
+    const int *ranks;          // The ranks whose values are needed, ascending.
+    int num_ranks;
+    const double *qs;          // The quantile each statistic (after the mean)
+    int num_stats;             // estimates.
+    int from, to;
+    int num_resamples;
+    uint64_t seed;             // Resample b is drawn from a generator seeded
+                               // from seed and b.
+    double *thetas;            // num_stats * num_resamples statistics.
+} Boot_Job;
+
+void *boot_work(void *);
+double jackknife_accel(const int64_t *, int, double);
+double quantile_without(const int64_t *, int, int, double);
+
+
+
+//
+// Estimate the mean, median and each of conf->percentiles of cmd's real times,
+// and their confidence intervals, storing them in cmd->boot_ests, boot_los and
+// boot_his respectively (each of which will have BOOT_STATS(conf) elements).
+// All are in seconds. If cmd has already been bootstrapped, does nothing.
+//
+
+void bootstrap(Conf *conf, Cmd *cmd)
+{
+    if (cmd->boot_ests != NULL)
+        return;
+
+    int n;
+    int num_stats = BOOT_STATS(conf);
+    int B = conf->bootstrap;
+
+    int64_t *xs = malloc(cmd->num_runs * sizeof(int64_t));
+    double *qs = malloc(num_stats * sizeof(double));
+    int *ranks = malloc(2 * num_stats * sizeof(int));
+    double *thetas = malloc((size_t) num_stats * B * sizeof(double));
+    double *ests = cmd->boot_ests = malloc(num_stats * sizeof(double));
+    double *los = cmd->boot_los = malloc(num_stats * sizeof(double));
+    double *his = cmd->boot_his = malloc(num_stats * sizeof(double));
+    if (xs == NULL || qs == NULL || ranks == NULL || thetas == NULL
+      || ests == NULL || los == NULL || his == NULL)
+        errx(1, "Out of memory.");
+    n = outliers_vals(conf, cmd, METRIC_REAL, xs);
+    qsort(xs, n, sizeof(int64_t), cmp_int64);
+    if (n == 0) {
+        // Every run failed or timed out.
+        for (int i = 0; i < num_stats; i += 1)
+            ests[i] = los[i] = his[i] = NAN;
+        free(xs);
+        free(qs);
+        free(ranks);
+        free(thetas);
+        return;
+    }
+
+    // Statistic 0 is the mean; the rest are quantiles, each of which needs
+    // the values at the two ranks it interpolates between.
+    qs[0] = -1;
+    qs[1] = 0.5;
+    for (int i = 0; i < conf->num_percentiles; i += 1)
+        qs[i + 2] = conf->percentiles[i];
+    int num_ranks = 0;
+    for (int i = 1; i < num_stats; i += 1) {
+        int r = (int) ((n - 1) * qs[i]);
+        ranks[num_ranks++] = r;
+        ranks[num_ranks++] = r < n - 1 ? r + 1 : r;
+    }
+    qsort(ranks, num_ranks, sizeof(int), cmp_int);
+
+    double sum = 0;
+    for (int i = 0; i < n; i += 1)
+        sum += xs[i];
+    ests[0] = sum / n;
+    for (int i = 1; i < num_stats; i += 1)
+        ests[i] = stats_quantile(xs, n, qs[i]);
+
+    // Divide the resamples between threads.
+
+    int num_jobs = 1;
+#   ifdef MT_HAVE_PTHREADS
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpus > 1)
+        num_jobs = ncpus < B ? ncpus : B;
+#   endif
+    Boot_Job jobs[num_jobs];
+    // Derive the seed from --seed (see schedule.c) and the command's
+    // position, and give every resample its own generator, so that the
+    // intervals are reproducible however many threads there are.
+    uint64_t seed = conf->seed;
+    for (int i = 0; i < conf->num_cmds && conf->cmds[i] != cmd; i += 1)
+        rng_next(&seed);
+    seed = rng_next(&seed);
+    for (int j = 0; j < num_jobs; j += 1) {
+        jobs[j] = (Boot_Job) {.xs = xs, .n = n, .ranks = ranks,
+          .num_ranks = num_ranks, .qs = qs, .num_stats = num_stats,
+          .from = (int) ((int64_t) B * j / num_jobs),
+          .to = (int) ((int64_t) B * (j + 1) / num_jobs),
+          .num_resamples = B, .seed = seed, .thetas = thetas};
+    }
+#   ifdef MT_HAVE_PTHREADS
+    pthread_t threads[num_jobs];
+    for (int j = 1; j < num_jobs; j += 1) {
+        if (pthread_create(&threads[j], NULL, boot_work, &jobs[j]) != 0)
+            errx(1, "Can't create bootstrap thread.");
+    }
+    boot_work(&jobs[0]);
+    for (int j = 1; j < num_jobs; j += 1)
+        pthread_join(threads[j], NULL);
+#   else
+    boot_work(&jobs[0]);
+#   endif
+
+    // Turn the resampled statistics into intervals.
+
+    double alpha = 1 - (double) conf->conf_level / 100;
+    double z_lo = stats_norm_inv(alpha / 2), z_hi = -z_lo;
+    for (int i = 0; i < num_stats; i += 1) {
+        double *ts = thetas + (size_t) i * B;
+        double p_lo = alpha / 2, p_hi = 1 - alpha / 2;
+
+        if (conf->boot_method == BOOT_BCA && n > 1) {
+            int below = 0, equal = 0;
+            for (int b = 0; b < B; b += 1) {
+                if (ts[b] < ests[i])
+                    below += 1;
+                else if (ts[b] == ests[i])
+                    equal += 1;
+            }
+            double p0 = (below + 0.5 * equal) / B;
+            if (p0 < 0.5 / B)
+                p0 = 0.5 / B;
+            else if (p0 > 1 - 0.5 / B)
+                p0 = 1 - 0.5 / B;
+            double z0 = stats_norm_inv(p0);
+            double a = jackknife_accel(xs, n, qs[i]);
+            p_lo = stats_norm_cdf(z0 + (z0 + z_lo) / (1 - a * (z0 + z_lo)));
+            p_hi = stats_norm_cdf(z0 + (z0 + z_hi) / (1 - a * (z0 + z_hi)));
+        }
+
+        qsort(ts, B, sizeof(double), cmp_double);
+        los[i] = stats_quantile_double(ts, B, p_lo) / 1000000000;
+        his[i] = stats_quantile_double(ts, B, p_hi) / 1000000000;
+        ests[i] /= 1000000000;
+    }
+
+    free(xs);
+    free(qs);
+    free(ranks);
+    free(thetas);
+}
+
+
+
+//
+// Compute the statistics of resamples job->from to job->to.
+//
+
+void *boot_work(void *arg)
+{
+    Boot_Job *job = arg;
+    int n = job->n;
+    uint32_t *counts = malloc(n * sizeof(uint32_t));
+    double *vals = malloc(job->num_ranks * sizeof(double));
+    if (counts == NULL || vals == NULL)
+        errx(1, "Out of memory.");
+    memset(counts, 0, n * sizeof(uint32_t));
+    for (int b = job->from; b < job->to; b += 1) {
+        uint64_t state = job->seed ^ ((uint64_t) b << 32);
+        state = rng_next(&state);
+        // Map each half of a 64-bit random number onto [0, n) by
+        // multiplication (Lemire 2019); the bias is at most n / 2^32.
+        int j;
+        for (j = 0; j + 1 < n; j += 2) {
+            uint64_t r = rng_next(&state);
+            counts[((r >> 32) * n) >> 32] += 1;
+            counts[((r & UINT32_MAX) * n) >> 32] += 1;
+        }
+        if (j < n)
+            counts[((rng_next(&state) >> 32) * n) >> 32] += 1;
+
+        // Walk the counts in order: the resample's k'th smallest (from 0)
+        // value is the first whose cumulative count exceeds k. The counts are
+        // reset as we go, ready for the next resample.
+        int64_t sum = 0, cum = 0;
+        int k = 0;
+        for (j = 0; j < n; j += 1) {
+            uint32_t c = counts[j];
+            counts[j] = 0;
+            sum += c * job->xs[j];
+            cum += c;
+            while (k < job->num_ranks && cum > job->ranks[k])
+                vals[k++] = job->xs[j];
+        }
+
+        job->thetas[b] = (double) sum / n;
+        for (int i = 1; i < job->num_stats; i += 1) {
+            double h = (n - 1) * job->qs[i];
+            int r = (int) h;
+            // Find the values at ranks r and r + 1 (which ranks holds in
+            // ascending order).
+            int l = 0;
+            while (job->ranks[l] != r)
+                l += 1;
+            double lo = vals[l], hi = lo;
+            if (r < n - 1) {
+                while (job->ranks[l] != r + 1)
+                    l += 1;
+                hi = vals[l];
+            }
+            job->thetas[(size_t) i * job->num_resamples + b] =
+              lo + (h - r) * (hi - lo);
+        }
+    }
+
+    free(counts);
+    free(vals);
+    return NULL;
+}
+
+
+
+//
+// Return the BCa acceleration of the q'th quantile (or, if q < 0, the mean)
+// of the n sorted values in xs, from the skewness of its jackknife values.
+//
+
+double jackknife_accel(const int64_t *xs, int n, double q)
+{
+    double *jk = malloc(n * sizeof(double));
+    if (jk == NULL)
+        errx(1, "Out of memory.");
+
+    double sum = 0;
+    for (int i = 0; i < n; i += 1)
+        sum += xs[i];
+    double jk_mean = 0;
+    for (int i = 0; i < n; i += 1) {
+        if (q < 0)
+            jk[i] = (sum - xs[i]) / (n - 1);
+        else
+            jk[i] = quantile_without(xs, n, i, q);
+        jk_mean += jk[i];
+    }
+    jk_mean /= n;
+
+    double num = 0, den = 0;
+    for (int i = 0; i < n; i += 1) {
+        double d = jk_mean - jk[i];
+        num += d * d * d;
+        den += d * d;
+    }
+    free(jk);
+
+    if (den == 0)
+        return 0;
+    return num / (6 * pow(den, 1.5));
+}
+
+
+
+//
+// Return the q'th quantile (as per stats_quantile) of the n sorted values in
+// xs with the i'th omitted.
+//
+
+double quantile_without(const int64_t *xs, int n, int i, double q)
+{
+    double h = (n - 2) * q;
+    int lo = (int) h;
+    int64_t x_lo = xs[lo < i ? lo : lo + 1];
+    if (lo >= n - 2)
+        return x_lo;
+    int64_t x_hi = xs[lo + 1 < i ? lo + 1 : lo + 2];
+    return x_lo + (h - lo) * (double) (x_hi - x_lo);
+}
@@ -0,0 +1,263 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Per-run cgroup v2 accounting.
+//
+// Each run is moved into a fresh leaf cgroup while it is held before exec
+// (so, as with perf.c, this needs an engine where the child waits for us).
+// Everything the command starts, including processes which daemonize and are
+// never waited for, stays in that cgroup, so its accounting covers the whole
+// process tree. Once the command has exited, any leftover processes are
+// killed and the cgroup removed.
+//
+
+#include "Config.h"
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "multitime.h"
+#include "cgroup.h"
+
+
+
+#define RMDIR_TRIES 1000 // How many milliseconds to wait for a cgroup to empty.
+
+// The controllers whose files we read, in addition to the always-present cpu
+// statistics.
+static const char *controllers[] = {"memory", "io", "pids", NULL};
+
+char *cgroup_path(const char *, const char *);
+bool cgroup_write(const char *, const char *, const char *);
+FILE *cgroup_open(const char *, const char *);
+int64_t cgroup_keyed(const char *, const char *, const char *);
+int64_t cgroup_single(const char *, const char *);
+
+
+
+//
+// Check that conf->cgroup is a cgroup v2 directory, and enable the controllers
+// we need for its children (warning if we can't).
+//
+
+void cgroup_probe(Conf *conf)
+{
+    char *procs = cgroup_path(conf->cgroup, "cgroup.procs");
+    if (access(procs, W_OK) == -1)
+        err(1, "%s is not a writable cgroup v2 directory", conf->cgroup);
+    free(procs);
+
+    for (int i = 0; controllers[i] != NULL; i += 1) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "+%s", controllers[i]);
+        if (!cgroup_write(conf->cgroup, "cgroup.subtree_control", buf))
+            warn("Can't enable the %s controller in %s (its measurements will "
+              "be 0)", controllers[i], conf->cgroup);
+    }
+}
+
+
+
+//
+// Create a new cgroup for run and move pid, which must not yet have exec'd,
+// into it.
+//
+
+void cgroup_enter(Conf *conf, Run *run, pid_t pid)
+{
+    static unsigned int num_cgroups = 0;
+
+    char name[64];
+    snprintf(name, sizeof(name), "multitime.%ld.%u", (long) getpid(),
+      num_cgroups);
+    num_cgroups += 1;
+    run->cgroup = cgroup_path(conf->cgroup, name);
+    if (mkdir(run->cgroup, S_IRWXU) == -1)
+        err(1, "Can't create cgroup %s", run->cgroup);
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%ld", (long) pid);
+    if (!cgroup_write(run->cgroup, "cgroup.procs", buf))
+        err(1, "Can't move process into cgroup %s", run->cgroup);
+}
+
+
+
+//
+// Read run's cgroup accounting into vals (which must have NUM_METRICS
+// elements), then kill anything still running in it and remove it.
+//
+
+void cgroup_read(Conf *conf, Run *run, int64_t *vals)
+{
+    if (run->cgroup == NULL)
+        return;
+
+    vals[METRIC_CG_CPU] = cgroup_keyed(run->cgroup, "cpu.stat", "usage_usec");
+    vals[METRIC_CG_MEM] = cgroup_single(run->cgroup, "memory.peak") / 1024;
+    vals[METRIC_CG_RBYTES] = cgroup_keyed(run->cgroup, "io.stat", "rbytes");
+    vals[METRIC_CG_WBYTES] = cgroup_keyed(run->cgroup, "io.stat", "wbytes");
+    vals[METRIC_CG_PIDS] = cgroup_single(run->cgroup, "pids.peak");
+
+    // cgroup.kill only exists from Linux 5.14; before that we have to signal
+    // each process ourselves (which can miss processes forked in the
+    // meantime, so we keep trying until the cgroup can be removed).
+    bool killed = cgroup_write(run->cgroup, "cgroup.kill", "1");
+    for (int i = 0; rmdir(run->cgroup) == -1; i += 1) {
+        if (errno != EBUSY || i == RMDIR_TRIES)
+            err(1, "Can't remove cgroup %s", run->cgroup);
+        if (!killed) {
+            FILE *f = cgroup_open(run->cgroup, "cgroup.procs");
+            long pid;
+            while (f != NULL && fscanf(f, "%ld", &pid) == 1)
+                kill((pid_t) pid, SIGKILL);
+            if (f != NULL)
+                fclose(f);
+        }
+        struct timespec ms = {0, 1000000};
+        nanosleep(&ms, NULL);
+    }
+
+    free(run->cgroup);
+    run->cgroup = NULL;
+}
+
+
+
+//
+// Return a newly allocated string "dir/file".
+//
+
+char *cgroup_path(const char *dir, const char *file)
+{
+    size_t len = strlen(dir) + strlen(file) + 2;
+    char *path = malloc(len);
+    if (path == NULL)
+        errx(1, "Out of memory.");
+    snprintf(path, len, "%s/%s", dir, file);
+
+    return path;
+}
+
+
+
+//
+// Write s to the file 'file' in the cgroup dir, returning true on success
+// (with errno set on failure).
+//
+
+bool cgroup_write(const char *dir, const char *file, const char *s)
+{
+    char *path = cgroup_path(dir, file);
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    free(path);
+    if (fd == -1)
+        return false;
+    ssize_t len = strlen(s);
+    bool ok = write(fd, s, len) == len;
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+
+    return ok;
+}
+
+
+
+//
+// Open the file 'file' in the cgroup dir for reading. Returns NULL if it
+// doesn't exist (e.g. because its controller isn't enabled).
+//
+
+FILE *cgroup_open(const char *dir, const char *file)
+{
+    char *path = cgroup_path(dir, file);
+    FILE *f = fopen(path, "re");
+    free(path);
+
+    return f;
+}
+
+
+
+//
+// Return the sum of every "key value" or "key=value" entry for key in the
+// cgroup file 'file' (io.stat has one line of such entries per device), or 0
+// if there are none.
+//
+
+int64_t cgroup_keyed(const char *dir, const char *file, const char *key)
+{
+    FILE *f = cgroup_open(dir, file);
+    if (f == NULL)
+        return 0;
+
+    int64_t sum = 0;
+    size_t key_len = strlen(key);
+    char word[256];
+    while (fscanf(f, "%255s", word) == 1) {
+        if (strncmp(word, key, key_len) != 0)
+            continue;
+        if (word[key_len] == '=')
+            sum += strtoimax(word + key_len + 1, NULL, 10);
+        else if (word[key_len] == '\0' && fscanf(f, "%255s", word) == 1)
+            sum += strtoimax(word, NULL, 10);
+    }
+    fclose(f);
+
+    return sum;
+}
+
+
+
+//
+// Return the single number held in the cgroup file 'file', or 0 if it doesn't
+// exist.
+//
+
+int64_t cgroup_single(const char *dir, const char *file)
+{
+    FILE *f = cgroup_open(dir, file);
+    if (f == NULL)
+        return 0;
+
+    intmax_t val = 0;
+    if (fscanf(f, "%jd", &val) != 1)
+        val = 0;
+    fclose(f);
+
+    return val;
+}
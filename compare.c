@@ -0,0 +1,186 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Comparing a command against a baseline.
+//
+// The speedup is the ratio of the baseline's mean real time to the command's,
+// with a confidence interval from the delta method. Whether the difference is
+// real is judged by two tests: Welch's t-test (which compares means, without
+// assuming equal variances) and the Mann-Whitney U test (which compares
+// distributions, without assuming normality, and so is robust to outliers).
+// A command is only judged faster or slower than the baseline if both tests
+// agree that the difference is significant at the confidence level.
+//
+
+#include "Config.h"
+
+#include <err.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "multitime.h"
+#include "compare.h"
+#include "outlier.h"
+#include "stats.h"
+
+const char *verdict_names[] = {"indistinguishable", "faster", "slower", NULL};
+
+// A real time and which command (0 = baseline) it belongs to.
+
+typedef struct {
+    int64_t val;
+    int grp;
+} Ranked;
+
+int cmp_ranked(const void *, const void *);
+double mann_whitney(const int64_t *, int, const int64_t *, int, double *);
+
+
+
+//
+// Compare cmd's real times with those of base, storing the result in cmp.
+//
+
+void compare(Conf *conf, Cmd *base, Cmd *cmd, Comparison *cmp)
+{
+    double alpha = 1 - (double) conf->conf_level / 100;
+    int64_t *bs = malloc((base->num_runs + 1) * sizeof(int64_t));
+    int64_t *cs = malloc((cmd->num_runs + 1) * sizeof(int64_t));
+    if (bs == NULL || cs == NULL)
+        errx(1, "Out of memory.");
+    int nb = outliers_vals(conf, base, METRIC_REAL, bs);
+    int nc = outliers_vals(conf, cmd, METRIC_REAL, cs);
+    if (nb == 0 || nc == 0) {
+        // Every run of one of the commands failed or timed out.
+        cmp->speedup = cmp->speedup_lo = cmp->speedup_hi = cmp->mw_a = NAN;
+        cmp->welch_p = cmp->mw_p = 1;
+        cmp->verdict = VERDICT_INDISTINGUISHABLE;
+        free(bs);
+        free(cs);
+        return;
+    }
+    double mb, sb, mc, sc;
+    int64_t min, max;
+    stats_moments(bs, nb, &mb, &sb, &min, &max);
+    stats_moments(cs, nc, &mc, &sc, &min, &max);
+    // Use the unbiased (sample) variances.
+    double vb = nb > 1 ? sb * sb * nb / (nb - 1) : 0;
+    double vc = nc > 1 ? sc * sc * nc / (nc - 1) : 0;
+
+    // Speedup, with its standard error from the delta method.
+    cmp->speedup = mc > 0 ? mb / mc : 0;
+    double rel_se = 0;
+    if (mb > 0 && mc > 0)
+        rel_se = sqrt(vb / nb / (mb * mb) + vc / nc / (mc * mc));
+    double z = -stats_norm_inv(alpha / 2);
+    cmp->speedup_lo = cmp->speedup * (1 - z * rel_se);
+    cmp->speedup_hi = cmp->speedup * (1 + z * rel_se);
+
+    // Welch's t-test, with the Welch-Satterthwaite degrees of freedom.
+    double se2 = vb / nb + vc / nc;
+    if (se2 == 0)
+        cmp->welch_p = mb == mc ? 1 : 0;
+    else {
+        double t = (mc - mb) / sqrt(se2);
+        double db = nb > 1 ? nb - 1 : 1, dc = nc > 1 ? nc - 1 : 1;
+        double df = se2 * se2 / (pow(vb / nb, 2) / db + pow(vc / nc, 2) / dc);
+        cmp->welch_p = stats_t_pvalue(t, df);
+    }
+
+    cmp->mw_p = mann_whitney(bs, nb, cs, nc, &cmp->mw_a);
+    free(bs);
+    free(cs);
+
+    if (cmp->welch_p < alpha && cmp->mw_p < alpha)
+        cmp->verdict = mc < mb ? VERDICT_FASTER : VERDICT_SLOWER;
+    else
+        cmp->verdict = VERDICT_INDISTINGUISHABLE;
+}
+
+
+
+//
+// Return the two-sided p-value of the Mann-Whitney U test of whether the nc
+// real times in cs differ from the nb in bs (the baseline's), using the normal
+// approximation (with corrections for ties and continuity). *a is set to the
+// probability that a value from cs is smaller than one from bs (counting ties
+// as half).
+//
+
+double mann_whitney(const int64_t *bs, int nb, const int64_t *cs, int nc,
+  double *a)
+{
+    int n = nb + nc;
+    Ranked *rs = malloc(n * sizeof(Ranked));
+    if (rs == NULL)
+        errx(1, "Out of memory.");
+    for (int i = 0; i < nb; i += 1)
+        rs[i] = (Ranked) {bs[i], 0};
+    for (int i = 0; i < nc; i += 1)
+        rs[nb + i] = (Ranked) {cs[i], 1};
+    qsort(rs, n, sizeof(Ranked), cmp_ranked);
+
+    // Sum cmd's ranks, giving tied values the average of their ranks.
+    double rank_sum = 0, ties = 0;
+    for (int i = 0; i < n; ) {
+        int j = i;
+        while (j < n && rs[j].val == rs[i].val)
+            j += 1;
+        double rank = (i + 1 + j) / 2.0;
+        for (int k = i; k < j; k += 1) {
+            if (rs[k].grp == 1)
+                rank_sum += rank;
+        }
+        double t = j - i;
+        ties += t * t * t - t;
+        i = j;
+    }
+    free(rs);
+
+    double u = rank_sum - (double) nc * (nc + 1) / 2;
+    double mean_u = (double) nb * nc / 2;
+    *a = 1 - u / ((double) nb * nc);
+    double var_u = (double) nb * nc / 12
+      * ((n + 1) - ties / ((double) n * (n - 1)));
+    if (var_u <= 0)
+        return 1;
+    double d = fabs(u - mean_u) - 0.5;
+    if (d < 0)
+        d = 0;
+    return 2 * (1 - stats_norm_cdf(d / sqrt(var_u)));
+}
+
+
+
+int cmp_ranked(const void *x, const void *y)
+{
+    int64_t a = ((const Ranked *) x)->val;
+    int64_t b = ((const Ranked *) y)->val;
+
+    return a < b ? -1 : a > b;
+}
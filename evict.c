@@ -0,0 +1,179 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Cold and warm page cache runs.
+//
+// Before each run, the files the user has listed are either evicted from the
+// page cache (a cold run) or read into it (a warm run), so that the effect of
+// the cache on a command can be measured without dropping the whole machine's
+// caches. How much of the files is resident is recorded before and after each
+// run, so that the user can see whether eviction actually worked (e.g. dirty
+// pages, or pages mapped by other processes, can't be evicted).
+//
+
+#include "Config.h"
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "multitime.h"
+#include "evict.h"
+
+
+
+#define READ_BUF_SIZE (64 * 1024)
+#define MAX_FTW_FDS 16
+
+// nftw's callback can't be given any state, so evict_add passes conf to it
+// through this.
+static Conf *ftw_conf;
+
+int add_file(const char *, const struct stat *, int, struct FTW *);
+void evict_file(int, bool);
+
+
+
+//
+// Add path to the files to be evicted before each cold run. If path is a
+// directory, every regular file beneath it is added.
+//
+
+void evict_add(Conf *conf, const char *path)
+{
+#   ifndef MT_HAVE_POSIX_FADVISE
+    errx(1, "--evict is not supported on this platform.");
+#   endif
+    ftw_conf = conf;
+    if (nftw(path, add_file, MAX_FTW_FDS, FTW_PHYS) == -1)
+        err(1, "Can't read '%s'", path);
+}
+
+
+
+int add_file(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    if (type != FTW_F || !S_ISREG(sb->st_mode))
+        return 0;
+
+    Conf *conf = ftw_conf;
+    conf->evict_files = realloc(conf->evict_files,
+      (conf->num_evict_files + 1) * sizeof(char *));
+    if (conf->evict_files == NULL || (conf->evict_files[conf->num_evict_files]
+      = strdup(path)) == NULL)
+        errx(1, "Out of memory.");
+    conf->num_evict_files += 1;
+
+    return 0;
+}
+
+
+
+//
+// Evict the user's files from the page cache if cold is true, or read them
+// into it otherwise.
+//
+
+void evict_prepare(Conf *conf, bool cold)
+{
+    for (int i = 0; i < conf->num_evict_files; i += 1) {
+        int fd = open(conf->evict_files[i], O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            err(1, "Can't open '%s'", conf->evict_files[i]);
+        evict_file(fd, cold);
+        close(fd);
+    }
+}
+
+
+
+void evict_file(int fd, bool cold)
+{
+#   ifdef MT_HAVE_POSIX_FADVISE
+    if (cold) {
+        // Only clean pages can be dropped, so write back any dirty ones first.
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        return;
+    }
+
+    // POSIX_FADV_WILLNEED only starts readahead, so we read the whole file
+    // to be sure it's resident by the time the run starts.
+    static char buf[READ_BUF_SIZE];
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    while (read(fd, buf, READ_BUF_SIZE) > 0)
+        ;
+#   endif
+}
+
+
+
+//
+// Return the percentage (in hundredths of a percent) of the user's files'
+// pages which are currently in the page cache.
+//
+
+int64_t evict_residency(Conf *conf)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    uint64_t resident = 0, total = 0;
+    for (int i = 0; i < conf->num_evict_files; i += 1) {
+        int fd = open(conf->evict_files[i], O_RDONLY | O_CLOEXEC);
+        struct stat sb;
+        if (fd == -1 || fstat(fd, &sb) == -1)
+            err(1, "Can't open '%s'", conf->evict_files[i]);
+        if (sb.st_size == 0) {
+            close(fd);
+            continue;
+        }
+
+        size_t pages = (sb.st_size + page_size - 1) / page_size;
+        void *addr = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        unsigned char *vec = malloc(pages);
+        if (addr == MAP_FAILED || vec == NULL
+          || mincore(addr, sb.st_size, vec) == -1)
+            err(1, "Can't check the residency of '%s'", conf->evict_files[i]);
+        for (size_t j = 0; j < pages; j += 1)
+            resident += vec[j] & 1;
+        total += pages;
+        free(vec);
+        munmap(addr, sb.st_size);
+        close(fd);
+    }
+
+    if (total == 0)
+        return 0;
+    return resident * 10000 / total;
+}
@@ -0,0 +1,686 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#include "Config.h"
+
+#include <err.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "multitime.h"
+#include "bootstrap.h"
+#include "compare.h"
+#include "format.h"
+#include "histogram.h"
+#include "layout.h"
+#include "outlier.h"
+#include "export.h"
+#include "store.h"
+#include "timeout.h"
+
+void export_num(FILE *, enum Metric, double);
+void json_num(FILE *, enum Metric, double);
+void json_val(FILE *, const char *, double);
+void json_str(FILE *, const char *);
+void csv_str(FILE *, const char *);
+void json_fit(FILE *, const char *, double);
+void json_comparison(FILE *, Comparison *);
+
+// The names of the fields of Summary, in the order they're exported.
+static const char *summary_names[] = {"mean", "ci", "stddev", "min", "median",
+  "max", NULL};
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Helpers
+//
+
+//
+// Open path for exporting to, where "-" means stdout.
+//
+
+FILE *export_open(const char *path)
+{
+    if (strcmp(path, "-") == 0)
+        return stdout;
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+        err(1, "Can't open '%s' for export", path);
+    return f;
+}
+
+
+
+void export_close(FILE *f, const char *path)
+{
+    if (f == stdout) {
+        if (fflush(f) != 0)
+            err(1, "Can't export to stdout");
+    }
+    else if (ferror(f) || fclose(f) != 0)
+        err(1, "Can't export to '%s'", path);
+}
+
+
+
+//
+// Return cmd as pp_cmd would print it. The caller must free the result.
+//
+
+char *cmd_str(Conf *conf, Cmd *cmd)
+{
+    char *buf;
+    size_t size;
+    FILE *f = open_memstream(&buf, &size);
+    if (f == NULL)
+        err(1, "cmd_str: open_memstream");
+    pp_cmd(f, conf, cmd);
+    if (fclose(f) != 0)
+        err(1, "cmd_str: fclose");
+    return buf;
+}
+
+
+
+//
+// Write the value v of metric m. Times (in seconds) are written to the
+// nanosecond; counters as integers where they are integral. Nothing is written
+// if v has no value (e.g. because every run failed).
+//
+
+void export_num(FILE *f, enum Metric m, double v)
+{
+    if (!isfinite(v))
+        return;
+    if (METRIC_IS_TIME(m))
+        fprintf(f, "%.9f", v);
+    else if (v == floor(v))
+        fprintf(f, "%.0f", v);
+    else
+        fprintf(f, "%.6f", v);
+}
+
+
+
+//
+// As export_num, but writes null if v has no value, as JSON has no NaN.
+//
+
+void json_num(FILE *f, enum Metric m, double v)
+{
+    if (isfinite(v))
+        export_num(f, m, v);
+    else
+        fprintf(f, "null");
+}
+
+
+
+//
+// Write v using the printf format fmt, or null if v has no value.
+//
+
+void json_val(FILE *f, const char *fmt, double v)
+{
+    if (isfinite(v))
+        fprintf(f, fmt, v);
+    else
+        fprintf(f, "null");
+}
+
+
+
+void json_str(FILE *f, const char *s)
+{
+    if (s == NULL) {
+        fprintf(f, "null");
+        return;
+    }
+
+    fputc('"', f);
+    for (; *s != '\0'; s += 1) {
+        switch (*s) {
+            case '"':
+                fprintf(f, "\\\"");
+                break;
+            case '\\':
+                fprintf(f, "\\\\");
+                break;
+            case '\n':
+                fprintf(f, "\\n");
+                break;
+            case '\r':
+                fprintf(f, "\\r");
+                break;
+            case '\t':
+                fprintf(f, "\\t");
+                break;
+            default:
+                if ((unsigned char) *s < 0x20)
+                    fprintf(f, "\\u%04x", (unsigned char) *s);
+                else
+                    fputc(*s, f);
+        }
+    }
+    fputc('"', f);
+}
+
+
+
+//
+// Write s as a CSV field, quoting it (as per RFC 4180) if necessary.
+//
+
+void csv_str(FILE *f, const char *s)
+{
+    if (strpbrk(s, ",\"\r\n") == NULL) {
+        fprintf(f, "%s", s);
+        return;
+    }
+
+    fputc('"', f);
+    for (; *s != '\0'; s += 1) {
+        if (*s == '"')
+            fputc('"', f);
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Exporters
+//
+
+//
+// Export the configuration, each command, its summary statistics (and
+// bootstrapped CIs and comparison with the baseline), and every run to path
+// as JSON. Runs are listed in the order they were recorded in; "order" gives
+// the position (from 1) in which each was started across all commands.
+//
+
+void export_json(Conf *conf, const char *path)
+{
+    FILE *f = export_open(path);
+
+    fprintf(f, "{\n  \"conf_level\": %d,\n  \"engine\": ", conf->conf_level);
+    json_str(f, engine_names[conf->engine]);
+    fprintf(f, ",\n  \"jobs\": %d,\n  \"overhead\": ", conf->jobs);
+    if (conf->calibrate == CALIBRATE_NONE)
+        fprintf(f, "null");
+    else
+        fprintf(f, "%.9f", (double) conf->overhead / 1000000000);
+    fprintf(f, ",\n  \"overhead_subtracted\": %s,\n  \"schedule\": ",
+      conf->calibrate == CALIBRATE_SUBTRACT ? "true" : "false");
+    json_str(f, schedule_names[conf->schedule]);
+    // The seed is a string, as many JSON readers can't hold a 64-bit integer.
+    fprintf(f, ",\n  \"seed\": \"%ju\",\n  \"sleep\": %.9f,\n  \"wait\": ",
+      (uintmax_t) conf->seed, conf->sleep);
+    json_str(f, wait_names[conf->wait]);
+    fprintf(f, ",\n  \"mean_wait\": ");
+    if (conf->num_waits == 0)
+        fprintf(f, "null");
+    else
+        fprintf(f, "%.9f", conf->waited / conf->num_waits);
+    fprintf(f, ",\n  \"capped_waits\": %d,\n  \"layouts\": [",
+      conf->num_layouts);
+    for (int i = 0; i < conf->num_layouts; i += 1) {
+        Layout *lay = &conf->layouts[i];
+        fprintf(f, "%s\n    {\"env_pad\": %d, \"aslr\": %s, \"pwd\": ",
+          i > 0 ? "," : "", lay->env_pad == -1 ? 0 : lay->env_pad,
+          lay->no_aslr ? "false" : "true");
+        json_str(f, lay->pwd);
+        fprintf(f, "}");
+    }
+    fprintf(f, "%s],\n  \"stream\": %s,\n  \"commands\": [",
+      conf->num_layouts > 0 ? "\n  " : "", conf->stream ? "true" : "false");
+
+    for (int i = 0; i < conf->num_cmds; i += 1) {
+        Cmd *cmd = conf->cmds[i];
+
+        fprintf(f, "%s\n    {\n      \"command\": ", i > 0 ? "," : "");
+        char *s = cmd_str(conf, cmd);
+        json_str(f, s);
+        free(s);
+        fprintf(f, ",\n      \"argv\": [");
+        for (int j = 0; cmd->argv[j] != NULL; j += 1) {
+            if (j > 0)
+                fprintf(f, ", ");
+            json_str(f, cmd->argv[j]);
+        }
+        fprintf(f, "]");
+        if (cmd->param_vals != NULL) {
+            fprintf(f, ",\n      \"params\": {");
+            for (int p = 0, k = 0; p < conf->num_params; p += 1) {
+                if (cmd->param_vals[p] == -1)
+                    continue;
+                fprintf(f, "%s", k++ > 0 ? ", " : "");
+                json_str(f, conf->params[p].name);
+                fprintf(f, ": ");
+                json_str(f, conf->params[p].vals[cmd->param_vals[p]]);
+            }
+            fprintf(f, "}");
+        }
+        fprintf(f, ",\n      \"replace_str\": ");
+        json_str(f, cmd->replace_str);
+        fprintf(f, ",\n      \"input_cmd\": ");
+        json_str(f, cmd->input_cmd);
+        fprintf(f, ",\n      \"pre_cmd\": ");
+        json_str(f, cmd->pre_cmd);
+        fprintf(f, ",\n      \"output_cmd\": ");
+        json_str(f, cmd->output_cmd);
+        fprintf(f, ",\n      \"quiet_stdout\": %s,\n      \"quiet_stderr\": %s,\n"
+          "      \"num_runs\": %d,\n      \"summary\": {",
+          cmd->quiet_stdout ? "true" : "false",
+          cmd->quiet_stderr ? "true" : "false",
+          cmd->num_runs);
+
+        for (enum Metric m = 0; m < NUM_METRICS; m += 1) {
+            if (!metric_enabled(conf, m))
+                continue;
+            Summary sm;
+            summarise(conf, cmd, m, &sm);
+            double vals[] = {sm.mean, sm.ci, sm.stddev, sm.min, sm.median,
+              sm.max};
+            fprintf(f, "%s\n        \"%s\": {", m > 0 ? "," : "",
+              metric_names[m]);
+            for (int k = 0; summary_names[k] != NULL; k += 1) {
+                fprintf(f, "%s\"%s\": ", k > 0 ? ", " : "", summary_names[k]);
+                json_num(f, m, vals[k]);
+            }
+            fprintf(f, "}");
+        }
+
+        fprintf(f, "\n      }");
+
+        if (timeout_reported(conf)) {
+            fprintf(f, ",\n      \"failed\": %d,\n      \"timed_out\": %d",
+              cmd->num_failed, cmd->num_timed_out);
+            if (cmd->num_timed_out > 0 && !conf->stream) {
+                Survival sv;
+                timeout_km(cmd, &sv);
+                fprintf(f, ",\n      \"kaplan_meier\": {\"median\": ");
+                json_val(f, "%.9f", sv.median);
+                fprintf(f, ", \"restricted_mean\": ");
+                json_val(f, "%.9f", sv.rmean);
+                fprintf(f, ", \"limit\": ");
+                json_val(f, "%.9f", sv.limit);
+                fprintf(f, "}");
+            }
+        }
+
+        if (conf->noise) {
+            double total = cmd->real_mean * cmd->num_done;
+            fprintf(f, ",\n      \"noisy_runs\": %d,\n      \"noisy_real\": %.9f",
+              cmd->num_noisy, total > 0 ? cmd->noisy_real / total : 0);
+        }
+
+        if (conf->num_layouts > 0) {
+            Layout_Anova an;
+            layout_anova(cmd, &an);
+            fprintf(f, ",\n      \"layout\": {\"layouts\": %d", an.num_layouts);
+            if (isnan(an.share))
+                fprintf(f, ", \"share\": null, \"between_sd\": null, "
+                  "\"within_sd\": null, \"p\": null}");
+            else
+                fprintf(f, ", \"share\": %.6f, \"between_sd\": %.9f, "
+                  "\"within_sd\": %.9f, \"p\": %.6f}", an.share,
+                  an.between_sd, an.within_sd, an.p);
+        }
+
+        if (conf->num_percentiles > 0) {
+            double qs[conf->num_percentiles];
+            fprintf(f, ",\n      \"percentiles\": {");
+            for (enum Metric m = 0; m < NUM_METRICS; m += 1) {
+                if (!metric_enabled(conf, m))
+                    continue;
+                summarise_quantiles(conf, cmd, m, qs);
+                fprintf(f, "%s\n        \"%s\": {", m > 0 ? "," : "",
+                  metric_names[m]);
+                for (int k = 0; k < conf->num_percentiles; k += 1) {
+                    fprintf(f, "%s\"p%g\": ", k > 0 ? ", " : "",
+                      conf->percentiles[k] * 100);
+                    json_num(f, m, qs[k]);
+                }
+                fprintf(f, "}");
+            }
+            fprintf(f, "\n      }");
+        }
+
+        if (conf->histogram) {
+            Histogram h;
+            histogram(conf, cmd, &h);
+            fprintf(f, ",\n      \"histogram\": {\"metric\": \"real\", "
+              "\"log\": %s, \"bins\": [", h.log ? "true" : "false");
+            for (int k = 0; k < h.num_bins; k += 1) {
+                fprintf(f, "%s\n        {\"lower\": ", k > 0 ? "," : "");
+                json_val(f, "%.9f", h.edges[k]);
+                fprintf(f, ", \"upper\": ");
+                json_val(f, "%.9f", h.edges[k + 1]);
+                fprintf(f, ", \"count\": %llu}",
+                  (unsigned long long) h.counts[k]);
+            }
+            fprintf(f, "\n      ]}");
+        }
+
+        if (conf->outliers != OUTLIERS_NONE) {
+            fprintf(f, ",\n      \"robust\": {");
+            for (enum Metric m = METRIC_REAL; m <= METRIC_SYS; m += 1) {
+                Robust r;
+                outliers_robust(cmd, m, &r);
+                fprintf(f, "%s\n        \"%s\": {\"trimmed_mean\": ",
+                  m > 0 ? "," : "", metric_names[m]);
+                json_val(f, "%.9f", r.trimmed_mean);
+                fprintf(f, ", \"mad\": ");
+                json_val(f, "%.9f", r.mad);
+                fprintf(f, ", \"iqr\": ");
+                json_val(f, "%.9f", r.iqr);
+                fprintf(f, "}");
+            }
+            fprintf(f, "\n      },\n      \"outliers\": {\"method\": \"%s\", "
+              "\"excluded\": %s, \"runs\": [",
+              outlier_method_names[conf->outliers],
+              conf->exclude_outliers ? "true" : "false");
+            for (int j = 0, k = 0; j < cmd->num_runs; j += 1) {
+                if (cmd->outliers[j])
+                    fprintf(f, "%s%d", k++ > 0 ? ", " : "", j + 1);
+            }
+            fprintf(f, "]}");
+        }
+
+        if (conf->bootstrap > 0) {
+            bootstrap(conf, cmd);
+            fprintf(f, ",\n      \"bootstrap\": {\"method\": \"%s\", "
+              "\"resamples\": %d, \"stats\": {",
+              boot_method_names[conf->boot_method], conf->bootstrap);
+            for (int k = 0; k < BOOT_STATS(conf); k += 1) {
+                if (k == 0)
+                    fprintf(f, "\n        \"mean\": ");
+                else if (k == 1)
+                    fprintf(f, ",\n        \"median\": ");
+                else
+                    fprintf(f, ",\n        \"p%g\": ",
+                      conf->percentiles[k - 2] * 100);
+                fprintf(f, "{\"estimate\": ");
+                json_val(f, "%.9f", cmd->boot_ests[k]);
+                fprintf(f, ", \"lower\": ");
+                json_val(f, "%.9f", cmd->boot_los[k]);
+                fprintf(f, ", \"upper\": ");
+                json_val(f, "%.9f", cmd->boot_his[k]);
+                fprintf(f, "}");
+            }
+            fprintf(f, "\n      }}");
+        }
+
+        if (conf->digest)
+            fprintf(f, ",\n      \"digest\": {\"xxh64\": \"%016llx\", "
+              "\"runs\": %d, \"differing\": %d}",
+              (unsigned long long) cmd->digest, cmd->num_digested,
+              cmd->num_digest_diffs);
+
+        if (conf->baseline >= 0 && i != conf->baseline) {
+            Comparison cmp;
+            compare(conf, conf->cmds[conf->baseline], cmd, &cmp);
+            fprintf(f, ",\n      \"comparison\": {\"baseline\": %d, ",
+              conf->baseline + 1);
+            json_comparison(f, &cmp);
+            fprintf(f, "}");
+        }
+
+        if (cmd->stored != NULL) {
+            Comparison *cmp = &cmd->stored->cmp;
+            fprintf(f, ",\n      \"stored_comparison\": {\"label\": ");
+            json_str(f, conf->compare_to);
+            fprintf(f, ", \"stored_at\": %jd, \"stored_runs\": %d, ",
+              (intmax_t) cmd->stored->when, cmd->stored->num_runs);
+            json_comparison(f, cmp);
+            fprintf(f, ", \"regression\": %s}",
+              store_regression(conf, cmd) ? "true" : "false");
+        }
+
+        if (conf->stream) {
+            // Individual runs aren't kept in streaming mode.
+            fprintf(f, "\n    }");
+            continue;
+        }
+        fprintf(f, ",\n      \"runs\": [");
+        for (int j = 0; j < cmd->num_runs; j += 1) {
+            fprintf(f, "%s\n        {\"run\": %d, \"order\": %d",
+              j > 0 ? "," : "", j + 1, cmd->orders[j] + 1);
+            for (enum Metric m = 0; m < NUM_METRICS; m += 1) {
+                if (!metric_enabled(conf, m))
+                    continue;
+                fprintf(f, ", \"%s\": ", metric_names[m]);
+                json_num(f, m, metric_value(cmd, j, m));
+            }
+            if (conf->digest)
+                fprintf(f, ", \"digest\": \"%016llx\"",
+                  (unsigned long long) cmd->digests[j]);
+            if (conf->outliers != OUTLIERS_NONE)
+                fprintf(f, ", \"outlier\": %s",
+                  cmd->outliers[j] ? "true" : "false");
+            if (timeout_reported(conf))
+                fprintf(f, ", \"status\": \"%s\"", state_names[cmd->states[j]]);
+            if (conf->noise)
+                fprintf(f, ", \"noisy\": %s",
+                  cmd->samples[METRIC_NOISE][j] > conf->noise_threshold * 100
+                  ? "true" : "false");
+            fprintf(f, "}");
+        }
+        fprintf(f, "\n      ]\n    }");
+    }
+    fprintf(f, "\n  ]");
+
+    if (conf->num_params > 0) {
+        fprintf(f, ",\n  \"sweeps\": [");
+        for (int i = 0; i < conf->num_sweeps; i += 1) {
+            Sweep *sw = &conf->sweeps[i];
+            Param *param = &conf->params[sw->param];
+            fprintf(f, "%s\n    {\"param\": ", i > 0 ? "," : "");
+            json_str(f, param->name);
+            fprintf(f, ", \"fixed\": {");
+            for (int p = 0, k = 0; p < conf->num_params; p += 1) {
+                int v = sw->cmds[0]->param_vals[p];
+                if (p == sw->param || v == -1)
+                    continue;
+                fprintf(f, "%s", k++ > 0 ? ", " : "");
+                json_str(f, conf->params[p].name);
+                fprintf(f, ": ");
+                json_str(f, conf->params[p].vals[v]);
+            }
+            fprintf(f, "}, \"points\": [");
+            for (int j = 0; j < param->num_vals; j += 1) {
+                int cmdi = 0;
+                while (conf->cmds[cmdi] != sw->cmds[j])
+                    cmdi += 1;
+                fprintf(f, "%s\n      {\"value\": ", j > 0 ? "," : "");
+                json_str(f, param->vals[j]);
+                fprintf(f, ", \"cmd\": %d, \"mean\": ", cmdi + 1);
+                json_val(f, "%.9f", sw->means[j]);
+                fprintf(f, "}");
+            }
+            fprintf(f, "\n    ], \"parallel\": %s",
+              sw->parallel ? "true" : "false");
+            json_fit(f, "exponent", sw->exponent);
+            json_fit(f, "exponent_r2", sw->exponent_r2);
+            json_fit(f, "serial_fraction", sw->serial);
+            json_fit(f, "amdahl_r2", sw->amdahl_r2);
+            json_fit(f, "linear_r2", sw->linear_r2);
+            fprintf(f, "}");
+        }
+        fprintf(f, "\n  ]");
+    }
+    fprintf(f, "\n}\n");
+
+    export_close(f, path);
+}
+
+
+
+//
+// Write the field name of a sweep's fit, and its value v (null if the fit
+// couldn't be made).
+//
+
+void json_fit(FILE *f, const char *name, double v)
+{
+    fprintf(f, ", \"%s\": ", name);
+    json_val(f, "%.6f", v);
+}
+
+
+
+//
+// Write the fields of the comparison cmp (without enclosing braces).
+//
+
+void json_comparison(FILE *f, Comparison *cmp)
+{
+    fprintf(f, "\"speedup\": ");
+    json_val(f, "%.6f", cmp->speedup);
+    fprintf(f, ", \"lower\": ");
+    json_val(f, "%.6f", cmp->speedup_lo);
+    fprintf(f, ", \"upper\": ");
+    json_val(f, "%.6f", cmp->speedup_hi);
+    fprintf(f, ", \"welch_p\": ");
+    json_val(f, "%.6g", cmp->welch_p);
+    fprintf(f, ", \"mann_whitney_p\": ");
+    json_val(f, "%.6g", cmp->mw_p);
+    fprintf(f, ", \"p_faster\": ");
+    json_val(f, "%.6f", cmp->mw_a);
+    fprintf(f, ", \"verdict\": \"%s\"", verdict_names[cmp->verdict]);
+}
+
+
+
+//
+// Export each command's runs and summary statistics to path as CSV. Each run
+// is a "run" record (except in streaming mode); each summary statistic and
+// percentile a record named after it (e.g. "mean" or "p99"), with empty run
+// and order fields.
+//
+
+void export_csv(Conf *conf, const char *path)
+{
+    FILE *f = export_open(path);
+
+    fprintf(f, "cmd,command,record,run,order");
+    for (enum Metric m = 0; m < NUM_METRICS; m += 1) {
+        if (metric_enabled(conf, m))
+            fprintf(f, ",%s", metric_names[m]);
+    }
+    if (conf->digest)
+        fprintf(f, ",digest");
+    if (conf->outliers != OUTLIERS_NONE)
+        fprintf(f, ",outlier");
+    bool status = timeout_reported(conf);
+    if (status)
+        fprintf(f, ",status");
+    fprintf(f, "\r\n");
+
+    for (int i = 0; i < conf->num_cmds; i += 1) {
+        Cmd *cmd = conf->cmds[i];
+        char *s = cmd_str(conf, cmd);
+
+        for (int j = 0; !conf->stream && j < cmd->num_runs; j += 1) {
+            fprintf(f, "%d,", i + 1);
+            csv_str(f, s);
+            fprintf(f, ",run,%d,%d", j + 1, cmd->orders[j] + 1);
+            for (enum Metric m = 0; m < NUM_METRICS; m += 1) {
+                if (!metric_enabled(conf, m))
+                    continue;
+                fprintf(f, ",");
+                export_num(f, m, metric_value(cmd, j, m));
+            }
+            if (conf->digest)
+                fprintf(f, ",%016llx", (unsigned long long) cmd->digests[j]);
+            if (conf->outliers != OUTLIERS_NONE)
+                fprintf(f, ",%d", cmd->outliers[j] ? 1 : 0);
+            if (status)
+                fprintf(f, ",%s", state_names[cmd->states[j]]);
+            fprintf(f, "\r\n");
+        }
+
+        Summary sms[NUM_METRICS];
+        for (enum Metric m = 0; m < NUM_METRICS; m += 1)
+            summarise(conf, cmd, m, &sms[m]);
+        for (int k = 0; summary_names[k] != NULL; k += 1) {
+            fprintf(f, "%d,", i + 1);
+            csv_str(f, s);
+            fprintf(f, ",%s,,", summary_names[k]);
+            for (enum Metric m = 0; m < NUM_METRICS; m += 1) {
+                if (!metric_enabled(conf, m))
+                    continue;
+                double vals[] = {sms[m].mean, sms[m].ci, sms[m].stddev,
+                  sms[m].min, sms[m].median, sms[m].max};
+                fprintf(f, ",");
+                export_num(f, m, vals[k]);
+            }
+            if (conf->digest)
+                fprintf(f, ",");
+            if (conf->outliers != OUTLIERS_NONE)
+                fprintf(f, ",");
+            if (status)
+                fprintf(f, ",");
+            fprintf(f, "\r\n");
+        }
+
+        // Each percentile is a record of its own, named after it (e.g. "p99").
+        double qs[NUM_METRICS][conf->num_percentiles + 1];
+        for (enum Metric m = 0; m < NUM_METRICS; m += 1) {
+            if (conf->num_percentiles > 0 && metric_enabled(conf, m))
+                summarise_quantiles(conf, cmd, m, qs[m]);
+        }
+        for (int k = 0; k < conf->num_percentiles; k += 1) {
+            fprintf(f, "%d,", i + 1);
+            csv_str(f, s);
+            fprintf(f, ",p%g,,", conf->percentiles[k] * 100);
+            for (enum Metric m = 0; m < NUM_METRICS; m += 1) {
+                if (!metric_enabled(conf, m))
+                    continue;
+                fprintf(f, ",");
+                export_num(f, m, qs[m][k]);
+            }
+            if (conf->digest)
+                fprintf(f, ",");
+            if (conf->outliers != OUTLIERS_NONE)
+                fprintf(f, ",");
+            if (status)
+                fprintf(f, ",");
+            fprintf(f, "\r\n");
+        }
+
+        free(s);
+    }
+
+    export_close(f, path);
+}
@@ -19,155 +19,322 @@
 // IN THE SOFTWARE.
 
 
+#include "Config.h"
+
 #include <assert.h>
+#include <err.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/resource.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include "multitime.h"
+#include "bootstrap.h"
+#include "compare.h"
+#include "evict.h"
+#include "histogram.h"
+#include "isolate.h"
+#include "layout.h"
+#include "outlier.h"
+#include "stats.h"
+#include "store.h"
+#include "stream.h"
+#include "timeout.h"
 #include "tvals.h"
 #include "zvals.h"
 
 extern char* __progname;
 
-#define TIMEVAL_TO_DOUBLE(t) \
-  ((double) (t)->tv_sec + (double) (t)->tv_usec / 1000000)
-
-void pp_cmd(Conf *, Cmd *);
-void pp_arg(const char *);
-
-
-
-void pp_cmd(Conf *conf, Cmd *cmd)
+// The widest bar drawn by format_histogram.
+#define HISTOGRAM_WIDTH 40
+
+// The most outlying runs listed by number before the rest are elided.
+#define MAX_LISTED_OUTLIERS 20
+
+const char *metric_names[] = {"real", "user", "sys", "maxrss", "minflt",
+  "majflt", "nswap", "inblock", "oublock", "msgsnd", "msgrcv", "nsignals",
+  "nvcsw", "nivcsw", "cycles", "instrs", "ipc", "cache-miss", "branch-miss",
+  "task-clock", "ctx-switch", "page-faults", "cg-cpu", "cg-mem", "cg-rbytes",
+  "cg-wbytes", "cg-pids", "rss-peak", "rss-mean", "cpu-mean", "cpu-peak",
+  "threads", "noise", "other-cpu", "interrupts", "paging", "psi-cpu",
+  "psi-mem", "psi-io", "cpu-mhz", "cache-pre", "cache-post", "layout",
+  "env-pad", "aslr", "pwd-pad", NULL};
+const double metric_scales[] = {1e-9, 1e-9, 1e-9, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1e-6, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1e-2, 1e-2, 1, 1e-2,
+  1e-2, 1, 1, 1e-2, 1e-2, 1e-2, 1, 1e-2, 1e-2, 1, 1, 1, 1};
+
+
+void pp_arg(FILE *, const char *);
+const char *time_unit(double, double *);
+void summarise_cache(Conf *, Cmd *, enum Metric, bool, Summary *);
+void summarise_vals(Conf *, enum Metric, int64_t *, int, Summary *);
+int summary_n(Conf *, Cmd *);
+void format_time_row(const char *, Summary *);
+void format_cache(Conf *, Cmd *);
+void format_control(Conf *, Cmd *, double, double);
+void format_adaptive(Conf *, Cmd *, double, double);
+void format_bootstrap(Conf *, Cmd *);
+void format_comparison(Conf *);
+void format_digest(Conf *, Cmd *);
+void format_outliers(Conf *, Cmd *);
+void format_failures(Conf *, Cmd *);
+void format_noise(Conf *, Cmd *);
+void format_layout(Conf *, Cmd *);
+void format_percentiles(Conf *, Cmd *);
+void format_histogram(Conf *, Cmd *);
+void format_stored(Conf *);
+void format_sweep(Conf *, Sweep *);
+
+
+
+void pp_cmd(FILE *f, Conf *conf, Cmd *cmd)
 {
     // Pretty-print the commands argv: we try to be semi-sensible about
     // escaping strings, but it's never going to be perfect, as the rules
     // are somewhat shell dependent.
 
     if (cmd->replace_str) {
-        fprintf(stderr, "-I ");
-        pp_arg(cmd->replace_str);
-        fprintf(stderr, " ");
+        fprintf(f, "-I ");
+        pp_arg(f, cmd->replace_str);
+        fprintf(f, " ");
     }
 
     if (cmd->input_cmd) {
-        fprintf(stderr, "-i ");
-        pp_arg(cmd->input_cmd);
-        fprintf(stderr, " ");
+        fprintf(f, "-i ");
+        pp_arg(f, cmd->input_cmd);
+        fprintf(f, " ");
     }
 
     if (cmd->pre_cmd) {
-        fprintf(stderr, "-r ");
-        pp_arg(cmd->pre_cmd);
-        fprintf(stderr, " ");
+        fprintf(f, "-r ");
+        pp_arg(f, cmd->pre_cmd);
+        fprintf(f, " ");
     }
 
     if (cmd->output_cmd) {
-        fprintf(stderr, "-o ");
-        pp_arg(cmd->output_cmd);
-        fprintf(stderr, " ");
+        fprintf(f, "-o ");
+        pp_arg(f, cmd->output_cmd);
+        fprintf(f, " ");
     }
 
     if (cmd->quiet_stderr)
-        fprintf(stderr, "-qq ");
+        fprintf(f, "-qq ");
     else if (cmd->quiet_stdout)
-        fprintf(stderr, "-q ");
+        fprintf(f, "-q ");
+
+    isolate_pp(f, &cmd->iso);
 
     for (int i = 0; cmd->argv[i] != NULL; i += 1) {
         if (i > 0)
-            fprintf(stderr, " ");
-        pp_arg(cmd->argv[i]);
+            fprintf(f, " ");
+        pp_arg(f, cmd->argv[i]);
     }
 }
 
 
 
-void pp_arg(const char *s)
+void pp_arg(FILE *f, const char *s)
 {
     if (strchr(s, ' ') == NULL)
-        fprintf(stderr, "%s", s);
+        fprintf(f, "%s", s);
     else {
-        fprintf(stderr, "\"");
+        fprintf(f, "\"");
         for (int k = 0; k < strlen(s); k += 1) {
             if (s[k] == '\"')
-                fprintf(stderr, "\\\"");
+                fprintf(f, "\\\"");
             else
-                fprintf(stderr, "%c", s[k]);
+                fprintf(f, "%c", s[k]);
         }
-        fprintf(stderr, "\"");
+        fprintf(f, "\"");
     }
 }
 
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// Comparison commands
+// Statistics
+//
+
 //
-// These are needed for the various calls to quicksort in format_other
+// Return the t-value (when n < 30) or Z-value used to calculate a confidence
+// interval at conf->conf_level for a sample of size n.
 //
 
-int cmp_timeval(const void *x, const void *y)
+double z_t(Conf *conf, int n)
 {
-    const struct timeval *t1 = *((const struct timeval **) x);
-    const struct timeval *t2 = *((const struct timeval **) y);
-
-    if (t1->tv_sec < t2->tv_sec
-      || (t1->tv_sec == t2->tv_sec && t1->tv_usec < t2->tv_usec))
-        return -1;
-    else if (t1->tv_sec == t2->tv_sec && t1->tv_usec == t2->tv_usec)
-        return 0;
+    if (n < 30)
+        return tvals[conf->conf_level - 1][n - 1];
     else
-        return 1;
+        return zvals[conf->conf_level - 1];
 }
 
 
 
-int cmp_rusage_utime(const void *x, const void *y)
+//
+// Return the value of metric m for run runi of cmd. Times are in seconds.
+//
+
+double metric_value(Cmd *cmd, int runi, enum Metric m)
 {
-    const struct timeval *t1 = &(*((const struct rusage **) x))->ru_utime;
-    const struct timeval *t2 = &(*((const struct rusage **) y))->ru_utime;
+    return cmd->samples[m][runi] * metric_scales[m];
+}
 
-    return cmp_timeval(&t1, &t2);
+
+
+//
+// Return true if metric m is being recorded.
+//
+
+bool metric_enabled(Conf *conf, enum Metric m)
+{
+    if (m < FIRST_PERF_METRIC)
+        return true;
+    if (m >= FIRST_LAYOUT_METRIC)
+        return conf->num_layouts > 0;
+    if (m >= FIRST_CACHE_METRIC)
+        return conf->num_evict_files > 0;
+    if (m >= FIRST_NOISE_METRIC)
+        return conf->noise;
+    if (m >= FIRST_SAMPLE_METRIC)
+        return conf->sample_interval > 0;
+    if (m >= FIRST_CGROUP_METRIC)
+        return conf->cgroup != NULL;
+    return conf->perf && (conf->perf_hw || !METRIC_IS_HW(m));
 }
 
 
 
-int cmp_rusage_stime(const void *x, const void *y)
+//
+// Calculate the summary statistics of metric m over cmd's runs. The runs
+// themselves are left in the order they were executed.
+//
+
+void summarise(Conf *conf, Cmd *cmd, enum Metric m, Summary *s)
 {
-    const struct timeval *t1 = &(*((const struct rusage **) x))->ru_stime;
-    const struct timeval *t2 = &(*((const struct rusage **) y))->ru_stime;
+    if (conf->stream) {
+        stream_summarise(conf, &cmd->streams[m], m, s);
+        return;
+    }
 
-    return cmp_timeval(&t1, &t2);
+    // Selection partially reorders its input, so work on a copy.
+    int64_t *vals = malloc(cmd->num_runs * sizeof(int64_t));
+    if (vals == NULL)
+        err(1, "summarise: malloc");
+    int n = outliers_vals(conf, cmd, m, vals);
+    summarise_vals(conf, m, vals, n, s);
+    free(vals);
 }
 
 
 
-#define RUSAGE_CMP(n) int cmp_rusage_ ## n(const void *x, const void *y) \
-    { \
-        const long *l1 = &(*((const struct rusage **) x))->ru_ ## n; \
-        const long *l2 = &(*((const struct rusage **) y))->ru_ ## n; \
-        if (*l1 < *l2) \
-            return -1; \
-        else if (*l1 == *l2) \
-            return 0; \
-        return 1; \
+//
+// Return how many of cmd's runs summarise includes: those which succeeded and,
+// with --exclude-outliers, aren't outliers.
+//
+
+int summary_n(Conf *conf, Cmd *cmd)
+{
+    if (conf->stream)
+        return (int) cmd->streams[METRIC_REAL].n;
+
+    bool exclude = conf->exclude_outliers && cmd->outliers != NULL;
+    int n = 0;
+    for (int j = 0; j < cmd->num_runs; j += 1) {
+        if (RUN_IS_OK(cmd, j) && !(exclude && cmd->outliers[j]))
+            n += 1;
     }
 
-RUSAGE_CMP(maxrss)
-RUSAGE_CMP(minflt)
-RUSAGE_CMP(majflt)
-RUSAGE_CMP(nswap)
-RUSAGE_CMP(inblock)
-RUSAGE_CMP(oublock)
-RUSAGE_CMP(msgsnd)
-RUSAGE_CMP(msgrcv)
-RUSAGE_CMP(nsignals)
-RUSAGE_CMP(nvcsw)
-RUSAGE_CMP(nivcsw)
+    return n;
+}
+
+
+
+//
+// As summarise, but only over cmd's cold runs (if cold is true) or its warm
+// runs (see evict.c).
+//
+
+void summarise_cache(Conf *conf, Cmd *cmd, enum Metric m, bool cold,
+  Summary *s)
+{
+    int64_t *vals = malloc(cmd->num_runs * sizeof(int64_t));
+    if (vals == NULL)
+        err(1, "summarise_cache: malloc");
+    int n = 0;
+    for (int j = 0; j < cmd->num_runs; j += 1) {
+        if (RUN_IS_COLD(j) == cold && RUN_IS_OK(cmd, j)) {
+            vals[n] = cmd->samples[m][j];
+            n += 1;
+        }
+    }
+    summarise_vals(conf, m, vals, n, s);
+    free(vals);
+}
+
+
+
+//
+// Calculate each of conf->percentiles of metric m over cmd's runs, storing
+// them (scaled as Summary's fields are) in qs.
+//
+
+void summarise_quantiles(Conf *conf, Cmd *cmd, enum Metric m, double *qs)
+{
+    double scale = metric_scales[m];
+    if (conf->stream) {
+        for (int i = 0; i < conf->num_percentiles; i += 1)
+            qs[i] = stream_quantile(&cmd->streams[m], conf->percentiles[i])
+              * scale;
+        return;
+    }
+
+    int64_t *vals = malloc((cmd->num_runs + 1) * sizeof(int64_t));
+    if (vals == NULL)
+        err(1, "summarise_quantiles: malloc");
+    int n = outliers_vals(conf, cmd, m, vals);
+    qsort(vals, n, sizeof(int64_t), cmp_int64);
+    for (int i = 0; i < conf->num_percentiles; i += 1)
+        qs[i] = n > 0 ? stats_quantile(vals, n, conf->percentiles[i]) * scale
+          : NAN;
+    free(vals);
+}
+
+
+
+//
+// Calculate the summary statistics of the n values of metric m in vals, which
+// are reordered.
+//
+
+void summarise_vals(Conf *conf, enum Metric m, int64_t *vals, int n,
+  Summary *s)
+{
+    // Every run may have failed or timed out.
+    if (n == 0) {
+        s->mean = s->ci = s->stddev = s->min = s->median = s->max = NAN;
+        return;
+    }
+
+    int64_t min, max;
+    stats_moments(vals, n, &s->mean, &s->stddev, &min, &max);
+    s->min = min;
+    s->max = max;
+    s->median = stats_median(vals, n);
+
+    double scale = metric_scales[m];
+    s->mean *= scale;
+    s->stddev *= scale;
+    s->min *= scale;
+    s->median *= scale;
+    s->max *= scale;
+    s->ci = z_t(conf, n) * s->stddev / sqrt(n);
+}
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -179,211 +346,668 @@ void format_like_time(Conf *conf)
     // Formatting like /usr/bin/time only makes sense if a single command is run.
     assert(conf->num_cmds == 1);
 
-    struct timeval real, user, sys;
-    timerclear(&real);
-    timerclear(&user);
-    timerclear(&sys);
     Cmd *cmd = conf->cmds[0];
-    for (int i = 0; i < conf->num_runs; i += 1) {
-        timeradd(&real, cmd->timevals[i],           &real);
-        timeradd(&user, &cmd->rusages[0]->ru_utime, &user);
-        timeradd(&sys,  &cmd->rusages[0]->ru_stime, &sys);
-    }
+    Summary s;
+    summarise(conf, cmd, METRIC_REAL, &s);
+    uint64_t real = llround(s.mean * 1000000000);
+    summarise(conf, cmd, METRIC_USER, &s);
+    uint64_t user = llround(s.mean * 1000000000);
+    summarise(conf, cmd, METRIC_SYS, &s);
+    uint64_t sys = llround(s.mean * 1000000000);
 	fprintf(stderr, "real %9lld.%02lld\n",
-      (long long) (real.tv_sec / conf->num_runs), (long long) ((real.tv_usec / 10000) / conf->num_runs));
+      (long long) (real / 1000000000), (long long) (real % 1000000000 / 10000000));
 	fprintf(stderr, "user %9lld.%02lld\n",
-      (long long) (user.tv_sec / conf->num_runs), (long long) ((user.tv_usec / 10000) / conf->num_runs));
+      (long long) (user / 1000000000), (long long) (user % 1000000000 / 10000000));
 	fprintf(stderr, "sys  %9lld.%02lld\n",
-      (long long) (sys.tv_sec / conf->num_runs), (long long) ((sys.tv_usec / 10000) / conf->num_runs));
+      (long long) (sys / 1000000000), (long long) (sys % 1000000000 / 10000000));
 }
 
 
 
 void format_other(Conf *conf)
 {
-    double z_t = .0; // Z or t-value used to calculate confidence interval.
     fprintf(stderr, "===> %s results\n", __progname);
+    if (conf->calibrate != CALIBRATE_NONE) {
+        double scale;
+        const char *unit = time_unit((double) conf->overhead / 1000000000,
+          &scale);
+        fprintf(stderr, "Launch overhead (%s): %.3f%s",
+          engine_names[conf->engine],
+          (double) conf->overhead / 1000000000 * scale, unit);
+        if (conf->calibrate == CALIBRATE_SUBTRACT)
+            fprintf(stderr, " (subtracted from real times)");
+        fprintf(stderr, "\n");
+        if (conf->num_below_overhead > 0)
+            fprintf(stderr, "Warning: %d runs took less than the launch "
+              "overhead, so have negative real times\n",
+              conf->num_below_overhead);
+    }
+    if (conf->stream)
+        fprintf(stderr, "Streaming statistics: medians are estimated to "
+          "within 0.78%%\n");
+    if (conf->num_waits > 0)
+        fprintf(stderr, "Waits for quiescence: mean %.3fs, %d of %d gave up "
+          "after %gs\n", conf->waited / conf->num_waits,
+          conf->num_capped_waits, conf->num_waits, conf->sleep);
     for (int i = 0; i < conf->num_cmds; i += 1) {
         Cmd *cmd = conf->cmds[i];
 
-        if (conf->num_runs < 30) { // Use t-value.
-            z_t = tvals[conf->conf_level - 1][conf->num_runs - 1];
-        }
-        else { // num_runs over 30, use Z value.
-            z_t = zvals[conf->conf_level - 1];
-        }
-
         if (i > 0)
             fprintf(stderr, "\n");
         fprintf(stderr, "%d: ", i + 1);
-        pp_cmd(conf, cmd);
+        pp_cmd(stderr, conf, cmd);
         fprintf(stderr, "\n");
+        // The mean's CI uses the t-distribution for small samples, and the
+        // normal distribution otherwise (see z_t).
         fprintf(stderr,
-          "            Mean                Std.Dev.    Min         Median      Max\n");
-
-        // Means
-
-        struct timeval mean_real_tv, mean_user_tv, mean_sys_tv;
-        timerclear(&mean_real_tv);
-        timerclear(&mean_user_tv);
-        timerclear(&mean_sys_tv);
-        for (int j = 0; j < conf->num_runs; j += 1) {
-            timeradd(&mean_real_tv, cmd->timevals[j],           &mean_real_tv);
-            timeradd(&mean_user_tv, &cmd->rusages[j]->ru_utime, &mean_user_tv);
-            timeradd(&mean_sys_tv,  &cmd->rusages[j]->ru_stime, &mean_sys_tv);
-        }
-        double mean_real = (double)
-          TIMEVAL_TO_DOUBLE(&mean_real_tv) / conf->num_runs;
-        double mean_user = (double)
-          TIMEVAL_TO_DOUBLE(&mean_user_tv) / conf->num_runs;
-        double mean_sys  = (double)
-          TIMEVAL_TO_DOUBLE(&mean_sys_tv)  / conf->num_runs;
-
-        // Standard deviations
-
-        double real_stddev = 0, user_stddev = 0, sys_stddev = 0;
-        for (int j = 0; j < conf->num_runs; j += 1) {
-            real_stddev   +=
-              pow(TIMEVAL_TO_DOUBLE(cmd->timevals[j]) - mean_real, 2);
-            user_stddev   +=
-              pow(TIMEVAL_TO_DOUBLE(&cmd->rusages[j]->ru_utime) - mean_user, 2);
-            sys_stddev    +=
-              pow(TIMEVAL_TO_DOUBLE(&cmd->rusages[j]->ru_stime) - mean_sys,  2);
+          "            %-20sStd.Dev.    Min         Median      Max\n",
+          summary_n(conf, cmd) < 30 ? "Mean (t CI)" : "Mean (z CI)");
+
+        Summary real, user, sys;
+        summarise(conf, cmd, METRIC_REAL, &real);
+        summarise(conf, cmd, METRIC_USER, &user);
+        summarise(conf, cmd, METRIC_SYS, &sys);
+        format_time_row("real", &real);
+        format_time_row("user", &user);
+        format_time_row("sys", &sys);
+        if (timeout_reported(conf))
+            format_failures(conf, cmd);
+        if (conf->noise)
+            format_noise(conf, cmd);
+        if (conf->num_layouts > 0)
+            format_layout(conf, cmd);
+        if (conf->outliers != OUTLIERS_NONE)
+            format_outliers(conf, cmd);
+        if (conf->adaptive)
+            format_adaptive(conf, cmd, real.mean, real.ci);
+        if (conf->jobs > 1)
+            format_control(conf, cmd, real.mean, real.stddev);
+        if (conf->bootstrap > 0)
+            format_bootstrap(conf, cmd);
+        if (conf->num_evict_files > 0)
+            format_cache(conf, cmd);
+
+        //
+        // rusage, performance counter and cgroup output.
+        //
+
+        for (enum Metric m = METRIC_MAXRSS; m < NUM_METRICS; m += 1) {
+            // Page cache residency is only meaningful split into cold and
+            // warm runs (see format_cache), and layouts are summarised by
+            // format_layout.
+            if ((m < FIRST_PERF_METRIC && conf->format_style == FORMAT_NORMAL)
+              || m >= FIRST_CACHE_METRIC || !metric_enabled(conf, m))
+                continue;
+            Summary s;
+            summarise(conf, cmd, m, &s);
+            // Integer metrics have no value at all if every run failed.
+            if (metric_scales[m] < 1 || isnan(s.mean)) {
+                fprintf(stderr, "%-12s%-12.3f%-12.3f%-12.3f%-12.3f%-12.3f\n",
+                  metric_names[m], s.mean, s.stddev, s.min, s.median, s.max);
+                continue;
+            }
+            fprintf(stderr, "%-12s%-12ld%-12ld%-12ld%-12ld%-12ld\n",
+              metric_names[m],
+              (long) s.mean,
+              (long) s.stddev,
+              (long) s.min,
+              (long) s.median,
+              (long) s.max);
         }
-        real_stddev = sqrt(real_stddev / conf->num_runs);
-        user_stddev = sqrt(user_stddev / conf->num_runs);
-        sys_stddev  = sqrt(sys_stddev / conf->num_runs);
+        if (conf->num_percentiles > 0)
+            format_percentiles(conf, cmd);
+        if (conf->histogram)
+            format_histogram(conf, cmd);
+        if (conf->digest)
+            format_digest(conf, cmd);
+    }
+
+    if (conf->baseline >= 0)
+        format_comparison(conf);
+    if (conf->compare_to)
+        format_stored(conf);
+    for (int i = 0; i < conf->num_sweeps; i += 1)
+        format_sweep(conf, &conf->sweeps[i]);
+}
+
+
+
+//
+// Return the name of the unit best suited to displaying a row of times (in
+// seconds) whose mean is t, setting *scale to the factor that converts
+// seconds to that unit.
+//
+
+const char *time_unit(double t, double *scale)
+{
+    t = fabs(t);
+    if (t >= 1 || t == 0) {
+        *scale = 1;
+        return "s";
+    }
+    else if (t >= 1e-3) {
+        *scale = 1e3;
+        return "ms";
+    }
+    else if (t >= 1e-6) {
+        *scale = 1e6;
+        return "us";
+    }
+    *scale = 1e9;
+    return "ns";
+}
+
+
+
+//
+// Print a row of times (all in seconds), scaled to a unit suited to its mean.
+//
+
+void format_time_row(const char *name, Summary *s)
+{
+    double scale;
+    const char *unit = time_unit(s->mean, &scale);
+    char label[13], mean_ci[64];
+    snprintf(label, sizeof(label), "%s (%s)", name, unit);
+    snprintf(mean_ci, sizeof(mean_ci), "%.3f+/-%.4f", s->mean * scale,
+      s->ci * scale);
+    fprintf(stderr, "%-12s%-19s %-12.3f%-12.3f%-12.3f%-12.3f\n",
+      label,
+      mean_ci,
+      s->stddev * scale,
+      s->min * scale,
+      s->median * scale,
+      s->max * scale);
+}
 
 
-        // Confidence intervals (without means)
 
-        double real_ci = .0, user_ci = .0, sys_ci = .0;
-        real_ci = ((z_t * real_stddev) / sqrt(conf->num_runs));
-        user_ci = ((z_t * user_stddev) / sqrt(conf->num_runs));
-        sys_ci = ((z_t * sys_stddev) / sqrt(conf->num_runs));
+//
+// Print conf->percentiles of each of cmd's metrics that the main results show.
+//
 
-        // Mins and maxes
+void format_percentiles(Conf *conf, Cmd *cmd)
+{
+    fprintf(stderr, "           ");
+    for (int i = 0; i < conf->num_percentiles; i += 1) {
+        char name[16];
+        snprintf(name, sizeof(name), "p%g", conf->percentiles[i] * 100);
+        fprintf(stderr, " %-11s", name);
+    }
+    fprintf(stderr, "\n");
 
-        int mdl, mdr;
-        if (conf->num_runs % 2 == 0) {
-            mdl = conf->num_runs / 2 - 1; // Median left
-            mdr = conf->num_runs / 2;     // Median right
+    double qs[conf->num_percentiles];
+    for (enum Metric m = 0; m < NUM_METRICS; m += 1) {
+        if ((m > METRIC_SYS && m < FIRST_PERF_METRIC
+          && conf->format_style == FORMAT_NORMAL)
+          || m >= FIRST_CACHE_METRIC || !metric_enabled(conf, m))
+            continue;
+        summarise_quantiles(conf, cmd, m, qs);
+        if (METRIC_IS_TIME(m)) {
+            // Scale the whole row to suit its largest value.
+            double largest = 0, scale;
+            for (int i = 0; i < conf->num_percentiles; i += 1) {
+                if (qs[i] > largest)
+                    largest = qs[i];
+            }
+            const char *unit = time_unit(largest, &scale);
+            char label[13];
+            snprintf(label, sizeof(label), "%s (%s)", metric_names[m], unit);
+            fprintf(stderr, "%-12s", label);
+            for (int i = 0; i < conf->num_percentiles; i += 1)
+                fprintf(stderr, "%-12.3f", qs[i] * scale);
         }
         else {
-            mdl = conf->num_runs / 2;
-            mdr = 0; // Unused
+            fprintf(stderr, "%-12s", metric_names[m]);
+            for (int i = 0; i < conf->num_percentiles; i += 1) {
+                // Integer metrics have no value at all if every run failed.
+                if (metric_scales[m] < 1 || isnan(qs[i]))
+                    fprintf(stderr, "%-12.3f", qs[i]);
+                else
+                    fprintf(stderr, "%-12lld", llround(qs[i]));
+            }
         }
+        fprintf(stderr, "\n");
+    }
+}
 
-        double min_real, max_real, md_real;
-        qsort(cmd->timevals, conf->num_runs, sizeof(struct timeval *),
-          cmp_timeval);
-        min_real = TIMEVAL_TO_DOUBLE(cmd->timevals[0]);
-        max_real = TIMEVAL_TO_DOUBLE(cmd->timevals[conf->num_runs - 1]);
-        if (conf->num_runs % 2 == 0) {
-            struct timeval t;
-            timeradd(cmd->timevals[mdl], cmd->timevals[mdr], &t);
-            md_real = TIMEVAL_TO_DOUBLE(&t) / 2;
-        }
+
+
+//
+// Draw a histogram of cmd's real times as a bar per bin.
+//
+
+void format_histogram(Conf *conf, Cmd *cmd)
+{
+    Histogram h;
+    histogram(conf, cmd, &h);
+    if (h.num_bins == 0) {
+        fprintf(stderr, "histogram   No successful runs\n");
+        return;
+    }
+    uint64_t most = 0;
+    for (int i = 0; i < h.num_bins; i += 1) {
+        if (h.counts[i] > most)
+            most = h.counts[i];
+    }
+
+    double scale;
+    const char *unit = time_unit(h.edges[h.num_bins], &scale);
+    fprintf(stderr, "histogram   real (%s%s)\n", unit,
+      h.log ? ", log scale" : "");
+    char bar[HISTOGRAM_WIDTH + 1];
+    for (int i = 0; i < h.num_bins; i += 1) {
+        int len = most > 0 ? (int) ((h.counts[i] * HISTOGRAM_WIDTH + most - 1)
+          / most) : 0;
+        memset(bar, '#', len);
+        bar[len] = '\0';
+        char range[32];
+        snprintf(range, sizeof(range), "%.3f-%.3f", h.edges[i] * scale,
+          h.edges[i + 1] * scale);
+        fprintf(stderr, "  %-22s%-*s %llu\n", range, HISTOGRAM_WIDTH, bar,
+          (unsigned long long) h.counts[i]);
+    }
+}
+
+
+
+//
+// Print robust estimators of cmd's times, and which of its runs are outliers.
+//
+
+void format_outliers(Conf *conf, Cmd *cmd)
+{
+    fprintf(stderr, "            %-20sMAD         IQR\n", "Trimmed mean");
+    enum Metric ms[] = {METRIC_REAL, METRIC_USER, METRIC_SYS};
+    for (int i = 0; i < 3; i += 1) {
+        Robust r;
+        outliers_robust(cmd, ms[i], &r);
+        double scale;
+        const char *unit = time_unit(r.trimmed_mean, &scale);
+        char label[13];
+        snprintf(label, sizeof(label), "%s (%s)", metric_names[ms[i]], unit);
+        fprintf(stderr, "%-12s%-20.3f%-12.3f%-12.3f\n", label,
+          r.trimmed_mean * scale, r.mad * scale, r.iqr * scale);
+    }
+
+    fprintf(stderr, "outliers    %d of %d (%s%s)", cmd->num_outliers,
+      cmd->num_runs, outlier_method_names[conf->outliers],
+      conf->exclude_outliers ? ", excluded" : "");
+    int listed = 0;
+    for (int i = 0; i < cmd->num_runs && listed <= MAX_LISTED_OUTLIERS;
+      i += 1) {
+        if (!cmd->outliers[i])
+            continue;
+        if (listed == MAX_LISTED_OUTLIERS)
+            fprintf(stderr, ", ...");
         else
-            md_real = TIMEVAL_TO_DOUBLE(cmd->timevals[mdl]);
-
-        double min_user, max_user, md_user;
-        qsort(cmd->rusages, conf->num_runs,
-          sizeof(struct rusage *), cmp_rusage_utime);
-        min_user = TIMEVAL_TO_DOUBLE(&cmd->rusages[0]->ru_utime);
-        max_user = TIMEVAL_TO_DOUBLE(
-          &cmd->rusages[conf->num_runs - 1]->ru_utime);
-        if (conf->num_runs % 2 == 0) {
-            struct timeval t;
-            timeradd(&cmd->rusages[mdl]->ru_utime,
-              &cmd->rusages[mdr]->ru_utime, &t);
-            md_user = TIMEVAL_TO_DOUBLE(&t) / 2;
-        }
+            fprintf(stderr, "%s%d", listed == 0 ? ": runs " : ", ", i + 1);
+        listed += 1;
+    }
+    fprintf(stderr, "\n");
+}
+
+
+
+//
+// Report how many runs of cmd adaptive mode executed, and why it stopped.
+//
+
+void format_adaptive(Conf *conf, Cmd *cmd, double mean_real, double real_ci)
+{
+    double ci_pct = mean_real > 0 ? 100 * real_ci / mean_real : 0;
+    fprintf(stderr, "runs        %d (real CI +/-%.2f%% of mean", cmd->num_runs,
+      ci_pct);
+    if (conf->target_ci > 0) {
+        fprintf(stderr, ", target %.2f%% ", conf->target_ci);
+        if (cmd->converged)
+            fprintf(stderr, "met");
+        else if (cmd->num_runs >= conf->max_runs)
+            fprintf(stderr, "not met: max runs reached");
         else
-            md_user = TIMEVAL_TO_DOUBLE(&cmd->rusages[mdl]->ru_utime);
-
-        double min_sys, max_sys, md_sys;
-        qsort(cmd->rusages,  conf->num_runs,
-          sizeof(struct rusage *), cmp_rusage_stime);
-        min_sys = TIMEVAL_TO_DOUBLE(&cmd->rusages[0]->ru_stime);
-        max_sys = TIMEVAL_TO_DOUBLE(&cmd->rusages[conf->num_runs - 1]->ru_stime);
-        if (conf->num_runs % 2 == 0) {
-            struct timeval t;
-            timeradd(&cmd->rusages[mdl]->ru_stime,
-              &cmd->rusages[mdr]->ru_stime, &t);
-            md_sys = TIMEVAL_TO_DOUBLE(&t) / 2;
-        }
+            fprintf(stderr, "not met: time budget exhausted");
+    }
+    fprintf(stderr, ")\n");
+}
+
+
+
+//
+// Print bootstrapped estimates of cmd's mean, median and percentiles of real
+// time, with their confidence intervals, each tagged with the method used to
+// derive its interval.
+//
+
+void format_bootstrap(Conf *conf, Cmd *cmd)
+{
+    bootstrap(conf, cmd);
+
+    double scale;
+    const char *unit = time_unit(cmd->boot_ests[0], &scale);
+    char label[32];
+    snprintf(label, sizeof(label), "real (%s)", unit);
+    fprintf(stderr, "%-12sEstimate    %d%% CI from %d resamples\n", label,
+      conf->conf_level, conf->bootstrap);
+    for (int i = 0; i < BOOT_STATS(conf); i += 1) {
+        if (i == 0)
+            snprintf(label, sizeof(label), "mean");
+        else if (i == 1)
+            snprintf(label, sizeof(label), "median");
         else
-            md_sys = TIMEVAL_TO_DOUBLE(&cmd->rusages[mdl]->ru_stime);
-
-        // Print everything out
-
-      fprintf(stderr, "real        %.3f+/-%-12.4f%-12.3f%-12.3f%-12.3f%-12.3f\n",
-          mean_real,
-          real_ci,
-          real_stddev,
-          min_real,
-          md_real,
-          max_real);
-      fprintf(stderr, "user        %.3f+/-%-12.4f%-12.3f%-12.3f%-12.3f%-12.3f\n",
-          mean_user,
-          user_ci,
-          user_stddev,
-          min_user,
-          md_user,
-          max_user);
-      fprintf(stderr, "sys         %.3f+/-%-12.4f%-12.3f%-12.3f%-12.3f%-12.3f\n",
-          mean_sys,
-          sys_ci,
-          sys_stddev,
-          min_sys,
-          md_sys,
-          max_sys);
-        if (conf->format_style == FORMAT_NORMAL)
+            snprintf(label, sizeof(label), "p%g",
+              conf->percentiles[i - 2] * 100);
+        char ci[64];
+        snprintf(ci, sizeof(ci), "%.3f-%.3f", cmd->boot_los[i] * scale,
+          cmd->boot_his[i] * scale);
+        fprintf(stderr, "%-12s%-12.3f%-24s%s\n", label,
+          cmd->boot_ests[i] * scale, ci, boot_method_names[conf->boot_method]);
+    }
+}
+
+
+
+//
+// Compare every command's real times against the baseline's.
+//
+
+void format_comparison(Conf *conf)
+{
+    fprintf(stderr, "\n===> comparison with %d: ", conf->baseline + 1);
+    pp_cmd(stderr, conf, conf->cmds[conf->baseline]);
+    char ci[32];
+    snprintf(ci, sizeof(ci), "%d%% CI", conf->conf_level);
+    fprintf(stderr, "\n            Speedup     %-16sWelch p     M-W U p     "
+      "Verdict\n", ci);
+    for (int i = 0; i < conf->num_cmds; i += 1) {
+        if (i == conf->baseline)
             continue;
 
-        //
-        // rusage output.
-        //
+        Comparison cmp;
+        compare(conf, conf->cmds[conf->baseline], conf->cmds[i], &cmp);
+        char label[16];
+        snprintf(label, sizeof(label), "%d", i + 1);
+        snprintf(ci, sizeof(ci), "%.3f-%.3f", cmp.speedup_lo, cmp.speedup_hi);
+        fprintf(stderr, "%-12s%-12.3f%-16s%-12.4f%-12.4f%s\n", label,
+          cmp.speedup, ci, cmp.welch_p, cmp.mw_p, verdict_names[cmp.verdict]);
+    }
+}
+
+
+
+//
+// As format_comparison, but comparing each command with its stored results
+// (see store.c), and flagging regressions.
+//
 
-#       define RUSAGE_STAT(n) \
-          long sum_##n = 0; \
-          for (int j = 0; j < conf->num_runs; j += 1) \
-              sum_##n += cmd->rusages[j]->ru_##n; \
-          long mean_##n = (double) sum_##n / conf->num_runs; \
-          double stddev_##n = 0; \
-          for (int j = 0; j < conf->num_runs; j += 1) \
-              stddev_##n += pow(cmd->rusages[j]->ru_##n - mean_##n, 2); \
-          long min_##n, max_##n, md_##n; \
-          qsort(cmd->rusages, conf->num_runs, \
-            sizeof(struct rusage *), cmp_rusage_##n); \
-          min_##n = cmd->rusages[0]->ru_##n; \
-          max_##n = cmd->rusages[conf->num_runs - 1]->ru_##n; \
-          if (conf->num_runs % 2 == 0) \
-              md_##n = (cmd->rusages[mdl]->ru_##n + \
-                cmd->rusages[mdr]->ru_##n) / 2; \
-          else \
-              md_##n = cmd->rusages[mdl]->ru_##n; \
-          fprintf(stderr, #n); \
-          for (int j = 0; j < 12 - strlen(#n); j += 1) \
-              fprintf(stderr, " "); \
-          fprintf(stderr, "%-12ld%-12ld%-12ld%-12ld%-12ld\n", \
-            mean_##n, \
-            (long) sqrt(stddev_##n / conf->num_runs), \
-            min_##n, \
-            md_##n, \
-            max_##n);
-
-        RUSAGE_STAT(maxrss)
-        RUSAGE_STAT(minflt)
-        RUSAGE_STAT(majflt)
-        RUSAGE_STAT(nswap)
-        RUSAGE_STAT(inblock)
-        RUSAGE_STAT(oublock)
-        RUSAGE_STAT(msgsnd)
-        RUSAGE_STAT(msgrcv)
-        RUSAGE_STAT(nsignals)
-        RUSAGE_STAT(nvcsw)
-        RUSAGE_STAT(nivcsw)
+void format_stored(Conf *conf)
+{
+    fprintf(stderr, "\n===> comparison with stored results labelled '%s'",
+      conf->compare_to);
+    if (conf->threshold > 0)
+        fprintf(stderr, " (regression threshold %.2f%%)", conf->threshold);
+    char ci[32];
+    snprintf(ci, sizeof(ci), "%d%% CI", conf->conf_level);
+    fprintf(stderr, "\n            Speedup     %-16sWelch p     M-W U p     "
+      "Verdict\n", ci);
+    for (int i = 0; i < conf->num_cmds; i += 1) {
+        Cmd *cmd = conf->cmds[i];
+        char label[16];
+        snprintf(label, sizeof(label), "%d", i + 1);
+        if (cmd->stored == NULL) {
+            fprintf(stderr, "%-12sno stored results\n", label);
+            continue;
+        }
+
+        Comparison *cmp = &cmd->stored->cmp;
+        snprintf(ci, sizeof(ci), "%.3f-%.3f", cmp->speedup_lo,
+          cmp->speedup_hi);
+        char when[32];
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M",
+          localtime(&cmd->stored->when));
+        fprintf(stderr, "%-12s%-12.3f%-16s%-12.4f%-12.4f%s%s (%d runs, %s)\n",
+          label, cmp->speedup, ci, cmp->welch_p, cmp->mw_p,
+          verdict_names[cmp->verdict],
+          store_regression(conf, cmd) ? ": REGRESSION" : "",
+          cmd->stored->num_runs, when);
     }
 }
+
+
+
+//
+// Report how many of cmd's runs failed or timed out (which the statistics
+// leave out) and, if any timed out, Kaplan-Meier estimates of its real time
+// which allow for them.
+//
+
+void format_failures(Conf *conf, Cmd *cmd)
+{
+    int n = cmd->num_runs > 0 ? cmd->num_runs : 1;
+    fprintf(stderr, "failures    %d failed (%.1f%%), %d timed out (%.1f%%) of "
+      "%d runs\n", cmd->num_failed, 100.0 * cmd->num_failed / n,
+      cmd->num_timed_out, 100.0 * cmd->num_timed_out / n, cmd->num_runs);
+    if (cmd->num_timed_out == 0 || conf->stream)
+        return;
+
+    Survival sv;
+    timeout_km(cmd, &sv);
+    double scale;
+    const char *unit = time_unit(sv.limit, &scale);
+    fprintf(stderr, "censored    Kaplan-Meier median ");
+    if (isnan(sv.median))
+        fprintf(stderr, "> %.3f%s", sv.limit * scale, unit);
+    else
+        fprintf(stderr, "%.3f%s", sv.median * scale, unit);
+    fprintf(stderr, ", mean %.3f%s (restricted to %.3f%s)\n", sv.rmean * scale,
+      unit, sv.limit * scale, unit);
+}
+
+
+
+//
+// Print how many of cmd's runs were noisy (see sysmon.c), and what proportion
+// of its real time they took.
+//
+
+void format_noise(Conf *conf, Cmd *cmd)
+{
+    double total = cmd->real_mean * cmd->num_done;
+    fprintf(stderr, "noisy       %d of %d runs (%.1f%%) scored over %g%%, "
+      "taking %.1f%% of the real time\n", cmd->num_noisy, cmd->num_done,
+      cmd->num_done > 0 ? 100.0 * cmd->num_noisy / cmd->num_done : 0,
+      conf->noise_threshold, total > 0 ? 100 * cmd->noisy_real / total : 0);
+}
+
+
+
+//
+// Print how much of the variance of cmd's real times is due to the layout
+// its runs executed in (see layout.c).
+//
+
+void format_layout(Conf *conf, Cmd *cmd)
+{
+    Layout_Anova an;
+    layout_anova(cmd, &an);
+    if (isnan(an.share)) {
+        fprintf(stderr, "layout      Too few runs to estimate the variance "
+          "between layouts\n");
+        return;
+    }
+
+    double scale;
+    const char *unit = time_unit(fmax(an.between_sd, an.within_sd), &scale);
+    fprintf(stderr, "layout      %.1f%% of real time variance between %d of %d "
+      "layouts (sd %.3f%s, within %.3f%s), p=%.3f\n", 100 * an.share,
+      an.num_layouts, conf->num_layouts, an.between_sd * scale, unit,
+      an.within_sd * scale, unit, an.p);
+}
+
+
+
+//
+// Print how sw's mean real times scale with its parameter: speedups and
+// efficiencies for a degree of parallelism, or times relative to the smallest
+// value otherwise, followed by the fits made (see sweep.c).
+//
+
+void format_sweep(Conf *conf, Sweep *sw)
+{
+    Param *param = &conf->params[sw->param];
+    fprintf(stderr, "\n===> sweep of {%s}", param->name);
+    Cmd *first = sw->cmds[0];
+    // The other parameters are held fixed.
+    int num_fixed = 0;
+    for (int p = 0; p < conf->num_params; p += 1) {
+        if (p == sw->param || first->param_vals[p] == -1)
+            continue;
+        fprintf(stderr, "%s%s=%s", num_fixed++ > 0 ? ", " : " (",
+          conf->params[p].name, conf->params[p].vals[first->param_vals[p]]);
+    }
+    if (num_fixed > 0)
+        fprintf(stderr, ")");
+
+    double max = 0;
+    for (int i = 0; i < param->num_vals; i += 1)
+        max = fmax(max, sw->means[i]);
+    double scale;
+    const char *unit = time_unit(max, &scale);
+    char mean[16];
+    snprintf(mean, sizeof(mean), "Mean (%s)", unit);
+    fprintf(stderr, "\n%-12s%-12s%s\n", param->name, mean,
+      sw->parallel ? "Speedup     Efficiency  Command" : "Ratio       Command");
+
+    // Speedups and ratios are relative to the smallest value.
+    int ref = 0;
+    for (int i = 1; i < param->num_vals; i += 1) {
+        if (param->nums[i] < param->nums[ref])
+            ref = i;
+    }
+    for (int i = 0; i < param->num_vals; i += 1) {
+        int cmdi = 0;
+        while (conf->cmds[cmdi] != sw->cmds[i])
+            cmdi += 1;
+        fprintf(stderr, "%-12s%-12.3f", param->vals[i], sw->means[i] * scale);
+        if (sw->parallel) {
+            double speedup = sw->means[ref] / sw->means[i];
+            fprintf(stderr, "%-12.3f%-12.3f", speedup,
+              speedup * param->nums[ref] / param->nums[i]);
+        }
+        else if (!isnan(sw->exponent))
+            fprintf(stderr, "%-12.3f", sw->means[i] / sw->means[ref]);
+        else
+            fprintf(stderr, "%-12s", "-");
+        fprintf(stderr, "%d\n", cmdi + 1);
+    }
+
+    if (isnan(sw->exponent)) {
+        fprintf(stderr, "No fits: values of {%s} must be distinct positive "
+          "numbers.\n", param->name);
+        return;
+    }
+    if (sw->parallel) {
+        fprintf(stderr, "Amdahl's law: serial fraction %.4f", sw->serial);
+        if (sw->serial > 0)
+            fprintf(stderr, " (max speedup %.2f)", 1 / sw->serial);
+        fprintf(stderr, ", R^2 %.4f\n", sw->amdahl_r2);
+        fprintf(stderr, "Linear scaling: R^2 %.4f\n", sw->linear_r2);
+    }
+    fprintf(stderr, "Power law: time ~ %s^%.3f, R^2 %.4f\n", param->name,
+      sw->exponent, sw->exponent_r2);
+}
+
+
+
+//
+// Report whether every run of cmd produced byte-identical stdout.
+//
+
+void format_digest(Conf *conf, Cmd *cmd)
+{
+    if (cmd->num_digest_diffs == 0)
+        fprintf(stderr, "output      xxh64 %016llx (identical in all %d runs)\n",
+          (unsigned long long) cmd->digest, cmd->num_digested);
+    else
+        fprintf(stderr, "output      %d of %d runs differ from xxh64 %016llx\n",
+          cmd->num_digest_diffs, cmd->num_digested,
+          (unsigned long long) cmd->digest);
+}
+
+
+
+//
+// Print cmd's cold and warm runs' times and page cache residency side by side
+// (see evict.c).
+//
+
+void format_cache(Conf *conf, Cmd *cmd)
+{
+    char cold_h[32], warm_h[32];
+    snprintf(cold_h, sizeof(cold_h), "Cold (%d runs)", (cmd->num_runs + 1) / 2);
+    snprintf(warm_h, sizeof(warm_h), "Warm (%d runs)", cmd->num_runs / 2);
+    fprintf(stderr, "            %-20s%-20sCold/Warm\n", cold_h, warm_h);
+    enum Metric ms[] = {METRIC_REAL, METRIC_USER, METRIC_SYS, METRIC_CACHE_PRE,
+      METRIC_CACHE_POST};
+    for (int i = 0; i < (int) (sizeof(ms) / sizeof(ms[0])); i += 1) {
+        Summary cold, warm;
+        summarise_cache(conf, cmd, ms[i], true, &cold);
+        summarise_cache(conf, cmd, ms[i], false, &warm);
+        if (!METRIC_IS_TIME(ms[i])) {
+            char cold_s[32], warm_s[32];
+            snprintf(cold_s, sizeof(cold_s), "%.2f%%", cold.mean);
+            snprintf(warm_s, sizeof(warm_s), "%.2f%%", warm.mean);
+            fprintf(stderr, "%-12s%-20s%s\n", metric_names[ms[i]], cold_s,
+              warm_s);
+            continue;
+        }
+
+        double scale;
+        const char *unit = time_unit(cold.mean, &scale);
+        char label[13], cold_s[64], warm_s[64];
+        snprintf(label, sizeof(label), "%s (%s)", metric_names[ms[i]], unit);
+        snprintf(cold_s, sizeof(cold_s), "%.3f+/-%.4f", cold.mean * scale,
+          cold.ci * scale);
+        snprintf(warm_s, sizeof(warm_s), "%.3f+/-%.4f", warm.mean * scale,
+          warm.ci * scale);
+        fprintf(stderr, "%-12s%-19s %-19s ", label, cold_s, warm_s);
+        if (warm.mean > 0)
+            fprintf(stderr, "%.3f", cold.mean / warm.mean);
+        else
+            fprintf(stderr, "-");
+        fprintf(stderr, "\n");
+    }
+}
+
+
+
+//
+// Compare cmd's real times, taken in parallel, against its serial control
+// sample, reporting whether the difference in the means is significant at
+// the confidence level.
+//
+
+void format_control(Conf *conf, Cmd *cmd, double mean_real, double real_stddev)
+{
+    int n = conf->num_ctrl_runs;
+    double mean_ctrl, ctrl_stddev;
+    int64_t min, max;
+    stats_moments(cmd->ctrl_reals, n, &mean_ctrl, &ctrl_stddev, &min, &max);
+    mean_ctrl /= 1000000000;
+    ctrl_stddev /= 1000000000;
+
+    // A conservative two-sample test: the standard error of the difference in
+    // means is taken from both samples, but the t-value from the smaller one.
+    double se = sqrt(pow(real_stddev, 2) / cmd->num_runs
+      + pow(ctrl_stddev, 2) / n);
+    double diff = mean_real - mean_ctrl;
+    int min_n = n < cmd->num_runs ? n : cmd->num_runs;
+    bool significant = fabs(diff) > z_t(conf, min_n) * se;
+
+    fprintf(stderr, "parallel    ");
+    if (mean_ctrl > 0)
+        fprintf(stderr, "%+.1f%% ", 100 * diff / mean_ctrl);
+    else
+        fprintf(stderr, "%+.3f ", diff);
+    fprintf(stderr, "real vs. serial control of %d runs (%s)\n", n,
+      significant ? "significant" : "not significant");
+}
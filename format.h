@@ -19,7 +19,11 @@
 // IN THE SOFTWARE.
 
 
-void pp_cmd(Conf *, Cmd *);
-int cmp_timeval(const void *, const void *);
+void pp_cmd(FILE *, Conf *, Cmd *);
+double z_t(Conf *, int);
+double metric_value(Cmd *, int, enum Metric);
+bool metric_enabled(Conf *, enum Metric);
+void summarise(Conf *, Cmd *, enum Metric, Summary *);
+void summarise_quantiles(Conf *, Cmd *, enum Metric, double *);
 void format_like_time(Conf *);
 void format_other(Conf *);
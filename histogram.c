@@ -0,0 +1,141 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Histograms of real times.
+//
+// A command's real times are counted into between MIN_BINS and
+// MAX_HISTOGRAM_BINS bins (about the square root of the number of runs)
+// spanning the fastest to the slowest run. When the slowest run is at least
+// LOG_RATIO times the fastest, the bins are equally wide in log(time), so that
+// a cluster of fast runs isn't squashed into a single bin by a long tail. In
+// streaming mode, the values come from the stream's own histogram (see
+// stream.c), so are within its accuracy.
+//
+
+#include "Config.h"
+
+#include <err.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "multitime.h"
+#include "histogram.h"
+#include "outlier.h"
+#include "stream.h"
+
+#define MIN_BINS 5
+#define LOG_RATIO 10
+
+
+
+
+//
+// Count cmd's real times into h.
+//
+
+void histogram(Conf *conf, Cmd *cmd, Histogram *h)
+{
+    double scale = metric_scales[METRIC_REAL];
+    int64_t *vals = NULL;
+    int n;
+    double min, max;
+    if (conf->stream) {
+        Stream *st = &cmd->streams[METRIC_REAL];
+        n = st->n;
+        min = st->min * scale;
+        max = st->max * scale;
+    }
+    else {
+        if ((vals = malloc((cmd->num_runs + 1) * sizeof(int64_t))) == NULL)
+            errx(1, "Out of memory.");
+        n = outliers_vals(conf, cmd, METRIC_REAL, vals);
+        min = max = n > 0 ? vals[0] * scale : 0;
+        for (int i = 1; i < n; i += 1) {
+            if (vals[i] * scale < min)
+                min = vals[i] * scale;
+            if (vals[i] * scale > max)
+                max = vals[i] * scale;
+        }
+    }
+
+    // Every run may have failed or timed out, leaving nothing to count.
+    if (n == 0) {
+        h->num_bins = 0;
+        h->log = false;
+        h->edges[0] = NAN;
+        free(vals);
+        return;
+    }
+
+    int num_bins = (int) ceil(sqrt(n));
+    if (num_bins < MIN_BINS)
+        num_bins = MIN_BINS;
+    if (num_bins > MAX_HISTOGRAM_BINS)
+        num_bins = MAX_HISTOGRAM_BINS;
+    if (max == min)
+        num_bins = 1;
+    h->num_bins = num_bins;
+    h->log = min > 0 && max >= min * LOG_RATIO;
+    for (int i = 0; i <= num_bins; i += 1) {
+        if (h->log)
+            h->edges[i] = exp(log(min) + (log(max) - log(min)) * i / num_bins);
+        else
+            h->edges[i] = min + (max - min) * i / num_bins;
+        if (i < num_bins)
+            h->counts[i] = 0;
+    }
+    h->edges[num_bins] = max;
+
+    if (conf->stream)
+        stream_histogram(&cmd->streams[METRIC_REAL], scale, h);
+    else {
+        for (int i = 0; i < n; i += 1)
+            h->counts[histogram_bin(h, vals[i] * scale)] += 1;
+        free(vals);
+    }
+}
+
+
+
+//
+// Return the bin of h that v falls into. Each bin includes its lower edge;
+// the last also includes its upper edge.
+//
+
+int histogram_bin(Histogram *h, double v)
+{
+    int lo = 0, hi = h->num_bins - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (v >= h->edges[mid])
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
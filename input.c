@@ -0,0 +1,340 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Delivering -i input to runs.
+//
+// Each distinct (i.e. after -I replacement) input command is executed once,
+// and its output kept in an anonymous in-memory file (a memfd, where
+// available) which is then sealed so that no run can change it. Each run gets
+// its own read-only descriptor onto that file, so that runs executing in
+// parallel don't share a file offset. Runs whose command needs stdin to be a
+// pipe (--input-pipe) are instead fed from the file by a thread, which uses
+// splice, where available, so that the data isn't copied through user space.
+//
+
+#include "Config.h"
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef MT_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "multitime.h"
+#include "input.h"
+
+
+
+#define COPY_SIZE (1024 * 1024) // Max bytes to copy per splice/read.
+
+// A cached input: the command which generated it, and the file holding its
+// output. path is only set if the file is a (deleted on exit) temporary file
+// rather than a memfd.
+
+typedef struct {
+    char *input_cmd;
+    int fd;
+    char *path;
+} Input;
+
+static Input *inputs = NULL;
+static int num_inputs = 0;
+
+#ifdef MT_HAVE_PTHREADS
+typedef struct {
+    pthread_t thread;
+    int src, dst;
+} Feeder;
+#endif
+
+Input *generate(char *);
+int reopen(Input *);
+bool copy_fd(int, int);
+void unlink_inputs(void);
+#ifdef MT_HAVE_PTHREADS
+void *feed(void *);
+#endif
+
+
+
+//
+// Set up run->in_fd (and, for --input-pipe, run->feeder) to deliver the output
+// of input_cmd, which must have been replace()d and which is freed.
+//
+
+void input_open(Conf *conf, Run *run, char *input_cmd)
+{
+    // Outputs are only worth caching if some other run might use the same
+    // input command: if every run's input is different (e.g. with -I), the
+    // cache would simply hold every run's input in memory at once.
+    Cmd *cmd = run->cmd;
+    bool cache = cmd->replace_str == NULL
+      || strstr(cmd->input_cmd, cmd->replace_str) == NULL || conf->num_cmds > 1;
+
+    Input *in = NULL;
+    for (int i = 0; i < num_inputs; i += 1) {
+        if (strcmp(inputs[i].input_cmd, input_cmd) == 0) {
+            in = &inputs[i];
+            break;
+        }
+    }
+    Input uncached;
+    if (in == NULL) {
+        Input *gen = generate(input_cmd);
+        if (cache) {
+            inputs = realloc(inputs, (num_inputs + 1) * sizeof(Input));
+            if (inputs == NULL)
+                errx(1, "Out of memory.");
+            inputs[num_inputs] = *gen;
+            in = &inputs[num_inputs];
+            num_inputs += 1;
+        }
+        else {
+            uncached = *gen;
+            in = &uncached;
+        }
+        free(gen);
+    }
+    else
+        free(input_cmd);
+
+    int fd = reopen(in);
+    if (in == &uncached) {
+        close(uncached.fd);
+        if (uncached.path != NULL) {
+            unlink(uncached.path);
+            free(uncached.path);
+        }
+        free(uncached.input_cmd);
+    }
+
+    run->feeder = NULL;
+    if (!conf->input_pipe) {
+        run->in_fd = fd;
+        return;
+    }
+
+#   ifdef MT_HAVE_PTHREADS
+    int fds[2];
+    if (pipe(fds) == -1)
+        err(1, "Can't create pipe");
+    // Neither end of the pipe must leak into other runs' children, or the
+    // command would never see EOF.
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    Feeder *f = malloc(sizeof(Feeder));
+    if (f == NULL)
+        errx(1, "Out of memory.");
+    f->src = fd;
+    f->dst = fds[1];
+    if (pthread_create(&f->thread, NULL, feed, f) != 0)
+        errx(1, "Can't create thread.");
+    run->in_fd = fds[0];
+    run->feeder = f;
+#   else
+    errx(1, "--input-pipe is not supported on this platform.");
+#   endif
+}
+
+
+
+//
+// Release the resources input_open allocated for run, once it has finished.
+//
+
+void input_close(Run *run)
+{
+    if (run->in_fd == -1)
+        return;
+
+    // Closing our end of the pipe first means that the feeder can't block
+    // forever if the command exited without reading all its input.
+    close(run->in_fd);
+    run->in_fd = -1;
+#   ifdef MT_HAVE_PTHREADS
+    if (run->feeder != NULL) {
+        Feeder *f = run->feeder;
+        pthread_join(f->thread, NULL);
+        free(f);
+        run->feeder = NULL;
+    }
+#   endif
+}
+
+
+
+//
+// Run input_cmd, returning a new Input holding its output (which takes
+// ownership of input_cmd).
+//
+
+Input *generate(char *input_cmd)
+{
+    Input *in = malloc(sizeof(Input));
+    if (in == NULL)
+        errx(1, "Out of memory.");
+    in->input_cmd = input_cmd;
+    in->path = NULL;
+
+#   ifdef MT_HAVE_MEMFD_CREATE
+    in->fd = memfd_create("multitime-input", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (in->fd == -1)
+        err(1, "Can't create memfd");
+#   else
+    char tmpp[] = "/tmp/mt.XXXXXXXXXX";
+    umask(S_IRWXG | S_IRWXO | S_IXUSR);
+    in->fd = mkstemp(tmpp);
+    if (in->fd == -1 || (in->path = strdup(tmpp)) == NULL)
+        errx(1, "Can't create temporary file.");
+    fcntl(in->fd, F_SETFD, FD_CLOEXEC);
+    static bool registered = false;
+    if (!registered) {
+        atexit(unlink_inputs);
+        registered = true;
+    }
+#   endif
+
+    FILE *cmdf = popen(input_cmd, "r");
+    if (cmdf == NULL || !copy_fd(fileno(cmdf), in->fd) || pclose(cmdf) != 0)
+        errx(1, "Error when attempting to run %s.", input_cmd);
+
+#   ifdef MT_HAVE_MEMFD_CREATE
+    if (fcntl(in->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE
+      | F_SEAL_SEAL) == -1)
+        err(1, "Can't seal memfd");
+#   endif
+
+    return in;
+}
+
+
+
+//
+// Return a new read-only descriptor, with its own offset, onto in's file.
+//
+
+int reopen(Input *in)
+{
+    int fd;
+    if (in->path != NULL)
+        fd = open(in->path, O_RDONLY | O_CLOEXEC);
+    else {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", in->fd);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    if (fd == -1)
+        err(1, "Can't reopen the output of %s", in->input_cmd);
+
+    return fd;
+}
+
+
+
+//
+// Copy everything from src (from its current offset) to dst. Returns true on
+// success.
+//
+
+bool copy_fd(int src, int dst)
+{
+#   ifdef MT_HAVE_SPLICE
+    // splice needs one end to be a pipe; if neither is, fall back to copying.
+    ssize_t n;
+    while ((n = splice(src, NULL, dst, NULL, COPY_SIZE, 0)) > 0)
+        ;
+    if (n == 0)
+        return true;
+    if (errno != EINVAL)
+        return false;
+#   endif
+
+    // Feeders may be copying at the same time, so each call needs its own
+    // buffer.
+    char *buf = malloc(COPY_SIZE);
+    if (buf == NULL)
+        return false;
+    bool ok = true;
+    ssize_t r;
+    while (ok && (r = read(src, buf, COPY_SIZE)) > 0) {
+        for (ssize_t w = 0; ok && w < r;) {
+            ssize_t n = write(dst, buf + w, r - w);
+            ok = n != -1;
+            w += n;
+        }
+    }
+    free(buf);
+
+    return ok && r == 0;
+}
+
+
+
+void unlink_inputs(void)
+{
+    for (int i = 0; i < num_inputs; i += 1) {
+        if (inputs[i].path != NULL)
+            unlink(inputs[i].path);
+    }
+}
+
+
+
+#ifdef MT_HAVE_PTHREADS
+
+//
+// Feed a command's stdin pipe from its input file.
+//
+
+void *feed(void *arg)
+{
+    Feeder *f = arg;
+
+    // If the command exits without reading all its input, writing to the pipe
+    // must fail with EPIPE rather than killing us.
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    copy_fd(f->src, f->dst);
+    close(f->src);
+    close(f->dst);
+
+    return NULL;
+}
+
+#endif
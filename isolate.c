@@ -0,0 +1,502 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Isolating runs from the rest of the system: CPU affinity, scheduling policy,
+// niceness, I/O priority and NUMA memory binding; and limiting them: resource
+// limits and timeouts.
+//
+// Settings are parsed (and so checked) up front, and applied by the child
+// between fork and exec, which must therefore do nothing that isn't safe in a
+// vfork'd child. The exception is the timeout, which is enforced by us (see
+// timeout.c): the child merely puts itself in its own process group, so that
+// everything it starts can be signalled together.
+//
+
+#include "Config.h"
+
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(MT_HAVE_SCHED_SETAFFINITY) || defined(MT_HAVE_SCHED_SETSCHEDULER)
+#include <sched.h>
+#endif
+#if defined(MT_HAVE_IOPRIO) || defined(MT_HAVE_SET_MEMPOLICY)
+#include <sys/syscall.h>
+#endif
+#ifdef MT_HAVE_SET_MEMPOLICY
+#include <linux/mempolicy.h>
+#endif
+
+#include "multitime.h"
+#include "isolate.h"
+
+#ifdef MT_HAVE_SCHED_SETAFFINITY
+extern cpu_set_t *worker_cpus;
+#endif
+
+
+
+#define MAX_NUMA_NODES 1024
+
+// The I/O priority classes, as defined by Linux's ioprio_set. The level
+// (0 = highest, 7 = lowest) is only meaningful for rt and be.
+static const char *ioprio_names[] = {"none", "rt", "be", "idle", NULL};
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_DEFAULT_LEVEL 4
+
+#ifdef MT_HAVE_SCHED_SETSCHEDULER
+static const struct {
+    const char *name;
+    int policy;
+} sched_policies[] = {
+    {"other", SCHED_OTHER},
+#   ifdef SCHED_BATCH
+    {"batch", SCHED_BATCH},
+#   endif
+#   ifdef SCHED_IDLE
+    {"idle", SCHED_IDLE},
+#   endif
+    {"fifo", SCHED_FIFO},
+    {"rr", SCHED_RR},
+    {NULL, 0}
+};
+#endif
+
+// The resources --rlimit can limit.
+static const struct {
+    const char *name;
+    int resource;
+} rlimit_names[] = {
+    {"as", RLIMIT_AS},
+    {"core", RLIMIT_CORE},
+    {"cpu", RLIMIT_CPU},
+    {"fsize", RLIMIT_FSIZE},
+    {"nofile", RLIMIT_NOFILE},
+#   ifdef RLIMIT_NPROC
+    {"nproc", RLIMIT_NPROC},
+#   endif
+    {"stack", RLIMIT_STACK},
+    {NULL, 0}
+};
+
+const char *parse_cpus(Isolation *, const char *);
+const char *parse_sched(Isolation *, const char *);
+const char *parse_ioprio(Isolation *, const char *);
+const char *parse_rlimit(Isolation *, const char *);
+bool parse_int(const char *, int, int, int *);
+
+
+
+//
+// Set the isolation option 'name' (e.g. "cpus") to arg. Returns NULL on
+// success, or an error message.
+//
+
+const char *isolate_parse(Isolation *iso, const char *name, const char *arg)
+{
+    if (strcmp(name, "cpus") == 0)
+        return parse_cpus(iso, arg);
+    else if (strcmp(name, "sched") == 0)
+        return parse_sched(iso, arg);
+    else if (strcmp(name, "nice") == 0) {
+        if (!parse_int(arg, -20, 19, &iso->nice))
+            return "--nice must be between -20 and 19.";
+        iso->has_nice = true;
+        return NULL;
+    }
+    else if (strcmp(name, "ioprio") == 0)
+        return parse_ioprio(iso, arg);
+    else if (strcmp(name, "rlimit") == 0)
+        return parse_rlimit(iso, arg);
+    else if (strcmp(name, "timeout") == 0) {
+        char *end;
+        errno = 0;
+        double dval = strtod(arg, &end);
+        if (errno != 0 || *arg == '\0' || *end != '\0' || dval <= 0)
+            return "Invalid --timeout.";
+        iso->timeout = dval;
+        return NULL;
+    }
+    else if (strcmp(name, "numa-node") == 0) {
+#       ifdef MT_HAVE_SET_MEMPOLICY
+        if (!parse_int(arg, 0, MAX_NUMA_NODES - 1, &iso->numa_node))
+            return "Invalid --numa-node.";
+        iso->has_numa_node = true;
+        return NULL;
+#       else
+        return "--numa-node is not supported on this platform.";
+#       endif
+    }
+
+    return "Unknown option.";
+}
+
+
+
+//
+// Return true if iso changes anything from what runs would otherwise inherit
+// (the timeout aside, as it isn't applied by the child).
+//
+
+bool isolate_any(Isolation *iso)
+{
+    return iso->cpus != NULL || iso->has_sched || iso->has_nice
+      || iso->ioprio_class != 0 || iso->has_numa_node || iso->num_rlimits > 0;
+}
+
+
+
+//
+// Apply iso to the calling process, pinning it to the CPUs of worker if iso
+// doesn't specify CPUs (and worker isn't -1). Called in the child before it
+// execs. Returns NULL on success, or the name of the option which couldn't be
+// applied.
+//
+
+const char *isolate_apply(Isolation *iso, int worker)
+{
+    if (iso->timeout > 0 && setpgid(0, 0) == -1)
+        return "--timeout";
+
+#   ifdef MT_HAVE_SCHED_SETAFFINITY
+    if (iso->cpus != NULL) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int i = 0; i < iso->num_cpus; i += 1)
+            CPU_SET(iso->cpus[i], &cpus);
+        if (sched_setaffinity(0, sizeof(cpu_set_t), &cpus) == -1)
+            return "--cpus";
+    }
+    else if (worker >= 0
+      && sched_setaffinity(0, sizeof(cpu_set_t), &worker_cpus[worker]) == -1)
+        return "-j";
+#   endif
+
+#   ifdef MT_HAVE_SET_MEMPOLICY
+    if (iso->has_numa_node) {
+        unsigned long mask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))];
+        memset(mask, 0, sizeof(mask));
+        mask[iso->numa_node / (8 * sizeof(unsigned long))]
+          = 1UL << (iso->numa_node % (8 * sizeof(unsigned long)));
+        if (syscall(SYS_set_mempolicy, MPOL_BIND, mask, MAX_NUMA_NODES) == -1)
+            return "--numa-node";
+    }
+#   endif
+
+#   ifdef MT_HAVE_IOPRIO
+    if (iso->ioprio_class != 0) {
+        int ioprio = (iso->ioprio_class << IOPRIO_CLASS_SHIFT)
+          | iso->ioprio_level;
+        // 1 = IOPRIO_WHO_PROCESS.
+        if (syscall(SYS_ioprio_set, 1, 0, ioprio) == -1)
+            return "--ioprio";
+    }
+#   endif
+
+    if (iso->has_nice && setpriority(PRIO_PROCESS, 0, iso->nice) == -1)
+        return "--nice";
+
+    for (int i = 0; i < iso->num_rlimits; i += 1) {
+        struct rlimit rl = {iso->rlimit_vals[i], iso->rlimit_vals[i]};
+        if (setrlimit(iso->rlimit_res[i], &rl) == -1)
+            return "--rlimit";
+    }
+
+    // The scheduling policy is set last, so that a real-time child can't
+    // starve us while it is still setting itself up.
+#   ifdef MT_HAVE_SCHED_SETSCHEDULER
+    if (iso->has_sched) {
+        struct sched_param sp = {.sched_priority = iso->sched_prio};
+        if (sched_setscheduler(0, iso->sched_policy, &sp) == -1)
+            return "--sched";
+    }
+#   endif
+
+    return NULL;
+}
+
+
+
+//
+// Pretty-print iso as the options which would recreate it, each followed by a
+// space.
+//
+
+void isolate_pp(FILE *f, Isolation *iso)
+{
+    if (iso->cpus != NULL)
+        fprintf(f, "--cpus %s ", iso->cpu_list);
+
+#   ifdef MT_HAVE_SCHED_SETSCHEDULER
+    if (iso->has_sched) {
+        for (int i = 0; sched_policies[i].name != NULL; i += 1) {
+            if (sched_policies[i].policy == iso->sched_policy)
+                fprintf(f, "--sched %s", sched_policies[i].name);
+        }
+        if (iso->sched_policy == SCHED_FIFO || iso->sched_policy == SCHED_RR)
+            fprintf(f, ":%d", iso->sched_prio);
+        fprintf(f, " ");
+    }
+#   endif
+
+    if (iso->has_nice)
+        fprintf(f, "--nice %d ", iso->nice);
+
+    if (iso->ioprio_class != 0) {
+        fprintf(f, "--ioprio %s", ioprio_names[iso->ioprio_class]);
+        if (strcmp(ioprio_names[iso->ioprio_class], "idle") != 0)
+            fprintf(f, ":%d", iso->ioprio_level);
+        fprintf(f, " ");
+    }
+
+    if (iso->has_numa_node)
+        fprintf(f, "--numa-node %d ", iso->numa_node);
+
+    for (int i = 0; i < iso->num_rlimits; i += 1) {
+        for (int j = 0; rlimit_names[j].name != NULL; j += 1) {
+            if (rlimit_names[j].resource == iso->rlimit_res[i])
+                fprintf(f, "--rlimit %s=", rlimit_names[j].name);
+        }
+        if (iso->rlimit_vals[i] == RLIM_INFINITY)
+            fprintf(f, "unlimited ");
+        else
+            fprintf(f, "%ju ", (uintmax_t) iso->rlimit_vals[i]);
+    }
+
+    if (iso->timeout > 0)
+        fprintf(f, "--timeout %g ", iso->timeout);
+}
+
+
+
+//
+// Parse a CPU list such as "0,2,4-7" into iso.
+//
+
+const char *parse_cpus(Isolation *iso, const char *arg)
+{
+#   ifdef MT_HAVE_SCHED_SETAFFINITY
+    free(iso->cpus);
+    iso->cpus = NULL;
+    iso->num_cpus = 0;
+    const char *s = arg;
+    while (true) {
+        char *end;
+        errno = 0;
+        intmax_t lo = strtoimax(s, &end, 10), hi = lo;
+        if (errno != 0 || end == s || lo < 0 || lo >= CPU_SETSIZE)
+            return "Invalid --cpus list.";
+        if (*end == '-') {
+            s = end + 1;
+            hi = strtoimax(s, &end, 10);
+            if (errno != 0 || end == s || hi < lo || hi >= CPU_SETSIZE)
+                return "Invalid --cpus list.";
+        }
+        iso->cpus = realloc(iso->cpus,
+          (iso->num_cpus + hi - lo + 1) * sizeof(int));
+        if (iso->cpus == NULL)
+            errx(1, "Out of memory.");
+        for (intmax_t cpu = lo; cpu <= hi; cpu += 1) {
+            iso->cpus[iso->num_cpus] = cpu;
+            iso->num_cpus += 1;
+        }
+        if (*end == '\0')
+            break;
+        if (*end != ',')
+            return "Invalid --cpus list.";
+        s = end + 1;
+    }
+    iso->cpu_list = arg;
+
+    return NULL;
+#   else
+    return "--cpus is not supported on this platform.";
+#   endif
+}
+
+
+
+//
+// Parse a scheduling policy of the form "policy[:priority]" into iso.
+//
+
+const char *parse_sched(Isolation *iso, const char *arg)
+{
+#   ifdef MT_HAVE_SCHED_SETSCHEDULER
+    const char *colon = strchr(arg, ':');
+    size_t len = colon ? (size_t) (colon - arg) : strlen(arg);
+    int i;
+    for (i = 0; sched_policies[i].name != NULL; i += 1) {
+        if (strlen(sched_policies[i].name) == len
+          && strncmp(arg, sched_policies[i].name, len) == 0)
+            break;
+    }
+    if (sched_policies[i].name == NULL)
+        return "Unknown --sched policy.";
+
+    int policy = sched_policies[i].policy;
+    int min = sched_get_priority_min(policy), max = sched_get_priority_max(policy);
+    int prio = min;
+    if (colon && (min == max || !parse_int(colon + 1, min, max, &prio)))
+        return "Invalid --sched priority.";
+    iso->has_sched = true;
+    iso->sched_policy = policy;
+    iso->sched_prio = prio;
+
+    return NULL;
+#   else
+    return "--sched is not supported on this platform.";
+#   endif
+}
+
+
+
+//
+// Parse an I/O priority of the form "class[:level]" into iso.
+//
+
+const char *parse_ioprio(Isolation *iso, const char *arg)
+{
+#   ifdef MT_HAVE_IOPRIO
+    const char *colon = strchr(arg, ':');
+    size_t len = colon ? (size_t) (colon - arg) : strlen(arg);
+    // Class 0 ("none") can't be chosen explicitly.
+    int i;
+    for (i = 1; ioprio_names[i] != NULL; i += 1) {
+        if (strlen(ioprio_names[i]) == len
+          && strncmp(arg, ioprio_names[i], len) == 0)
+            break;
+    }
+    if (ioprio_names[i] == NULL)
+        return "Unknown --ioprio class.";
+
+    int level = strcmp(ioprio_names[i], "idle") == 0 ? 0 : IOPRIO_DEFAULT_LEVEL;
+    if (colon && (level == 0 || !parse_int(colon + 1, 0, 7, &level)))
+        return "Invalid --ioprio level.";
+    iso->ioprio_class = i;
+    iso->ioprio_level = level;
+
+    return NULL;
+#   else
+    return "--ioprio is not supported on this platform.";
+#   endif
+}
+
+
+
+//
+// Parse resource limits of the form "resource=value[,resource=value...]" into
+// iso, where each value is "unlimited" or a number optionally followed by K, M
+// or G (multiplying it by that power of 1024).
+//
+
+const char *parse_rlimit(Isolation *iso, const char *arg)
+{
+    const char *s = arg;
+    while (true) {
+        const char *eq = strchr(s, '=');
+        if (eq == NULL)
+            return "Invalid --rlimit.";
+        int i;
+        for (i = 0; rlimit_names[i].name != NULL; i += 1) {
+            if (strlen(rlimit_names[i].name) == (size_t) (eq - s)
+              && strncmp(s, rlimit_names[i].name, eq - s) == 0)
+                break;
+        }
+        if (rlimit_names[i].name == NULL)
+            return "Unknown --rlimit resource.";
+
+        rlim_t val;
+        char *end;
+        if (strncmp(eq + 1, "unlimited", 9) == 0) {
+            val = RLIM_INFINITY;
+            end = (char *) eq + 10;
+        }
+        else {
+            errno = 0;
+            uintmax_t v = strtoumax(eq + 1, &end, 10);
+            if (errno != 0 || end == eq + 1 || eq[1] == '-')
+                return "Invalid --rlimit value.";
+            const char *suffixes = "KMG", *sf;
+            if (*end != '\0' && (sf = strchr(suffixes, *end)) != NULL) {
+                for (int k = 0; k <= sf - suffixes; k += 1) {
+                    if (v > UINTMAX_MAX / 1024)
+                        return "Invalid --rlimit value.";
+                    v *= 1024;
+                }
+                end += 1;
+            }
+            val = (rlim_t) v;
+        }
+        if (*end != '\0' && *end != ',')
+            return "Invalid --rlimit value.";
+
+        // A later limit on the same resource overrides an earlier one.
+        int j;
+        for (j = 0; j < iso->num_rlimits; j += 1) {
+            if (iso->rlimit_res[j] == rlimit_names[i].resource)
+                break;
+        }
+        if (j == iso->num_rlimits) {
+            if (j == MAX_RLIMITS)
+                return "Too many --rlimit resources.";
+            iso->num_rlimits += 1;
+        }
+        iso->rlimit_res[j] = rlimit_names[i].resource;
+        iso->rlimit_vals[j] = val;
+
+        if (*end == '\0')
+            break;
+        s = end + 1;
+    }
+
+    return NULL;
+}
+
+
+
+//
+// Parse s as an integer between min and max inclusive into *r, returning true
+// on success.
+//
+
+bool parse_int(const char *s, int min, int max, int *r)
+{
+    char *end;
+    errno = 0;
+    intmax_t v = strtoimax(s, &end, 10);
+    if (errno != 0 || *s == '\0' || *end != '\0' || v < min || v > max)
+        return false;
+    *r = v;
+
+    return true;
+}
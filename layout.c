@@ -0,0 +1,337 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Memory layout randomisation.
+//
+// A command's speed can depend on incidental details of its memory layout,
+// such as the size of its environment (which shifts its stack) and where
+// ASLR places things, so timing every run in the same layout can bias the
+// results. With --randomize-layout and/or --randomize-pwd, NUM_LAYOUTS random
+// layouts are drawn before the first run, and each run executes in one of
+// them, picked at random. A layout may:
+//
+//   * pad the environment with a variable of random length;
+//   * turn ASLR off (Linux only);
+//   * set PWD to a path to the working directory which is a random number of
+//     characters longer: a symlink (in a temporary directory) to it. The
+//     kernel resolves symlinks, so getcwd() in the run still returns the real
+//     path: only PWD, and whatever uses it (e.g. shells), sees the padding.
+//
+// Each run's layout is recorded, and a one-way random effects analysis of
+// variance of the real times, with the layout as the factor, estimates how
+// much of their variance is due to layout.
+//
+
+#include "Config.h"
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef MT_HAVE_PERSONALITY
+#include <sys/personality.h>
+#endif
+
+#include "multitime.h"
+#include "layout.h"
+#include "schedule.h"
+#include "stats.h"
+
+
+
+// The name of the variable the environment is padded with.
+#define PAD_VAR "MULTITIME_PAD"
+// The longest environment padding, in bytes.
+#define MAX_ENV_PAD 4096
+// The most characters added to PWD (each must fit in a single file name).
+#define MAX_PWD_PAD 255
+
+extern char **environ;
+
+// The temporary directory holding the PWD symlinks. NULL = none.
+static char *pwd_dir;
+
+char **pad_env(int, const char *);
+char *pwd_link(int);
+void remove_pwds(void);
+
+
+
+
+//
+// Draw conf->num_layouts random layouts.
+//
+
+void layout_init(Conf *conf)
+{
+    conf->layouts = malloc(conf->num_layouts * sizeof(Layout));
+    if (conf->layouts == NULL)
+        errx(1, "Out of memory.");
+
+    char real_cwd[PATH_MAX];
+    if (conf->randomize_pwd) {
+        if (getcwd(real_cwd, sizeof(real_cwd)) == NULL)
+            err(1, "Can't determine the working directory");
+        const char *tmp = getenv("TMPDIR");
+        if (tmp == NULL || *tmp == '\0')
+            tmp = "/tmp";
+        if (asprintf(&pwd_dir, "%s/multitime.XXXXXX", tmp) == -1)
+            errx(1, "Out of memory.");
+        if (mkdtemp(pwd_dir) == NULL)
+            err(1, "Can't create a temporary directory in %s", tmp);
+        atexit(remove_pwds);
+    }
+
+    for (int i = 0; i < conf->num_layouts; i += 1) {
+        Layout *lay = &conf->layouts[i];
+        lay->env_pad = -1;
+        lay->no_aslr = false;
+        lay->pwd_pad = 0;
+        lay->pwd = NULL;
+        if (conf->randomize_layout) {
+            lay->env_pad = (int) schedule_randn(conf, MAX_ENV_PAD + 1);
+#           ifdef MT_HAVE_PERSONALITY
+            lay->no_aslr = schedule_randn(conf, 2) == 1;
+#           endif
+        }
+        if (conf->randomize_pwd) {
+            lay->pwd_pad = 1 + (int) schedule_randn(conf, MAX_PWD_PAD);
+            lay->pwd = pwd_link(lay->pwd_pad);
+            // Layouts may share a padding length, and so a symlink.
+            if (symlink(real_cwd, lay->pwd) == -1 && errno != EEXIST)
+                err(1, "Can't create %s", lay->pwd);
+        }
+        lay->envp = pad_env(lay->env_pad, lay->pwd);
+
+        if (conf->verbosity > 0) {
+            fprintf(stderr, "===> Layout %d:", i + 1);
+            if (lay->env_pad != -1)
+                fprintf(stderr, " %d bytes of environment padding, ASLR %s",
+                  lay->env_pad, lay->no_aslr ? "off" : "on");
+            if (lay->pwd != NULL)
+                fprintf(stderr, "%s PWD %s",
+                  lay->env_pad != -1 ? "," : "", lay->pwd);
+            fprintf(stderr, "\n");
+        }
+    }
+}
+
+
+
+//
+// Return the index of a random layout for a run to execute in.
+//
+
+int layout_pick(Conf *conf)
+{
+    return (int) schedule_randn(conf, conf->num_layouts);
+}
+
+
+
+//
+// Switch to layout lay. Called in the child before it execs, so (as it may be
+// a vfork'd child) it must not touch any of the parent's memory. Returns NULL
+// on success, or the name of the option which couldn't be applied.
+//
+
+const char *layout_apply(Layout *lay)
+{
+#   ifdef MT_HAVE_PERSONALITY
+    if (lay->no_aslr) {
+        int persona = personality(0xffffffff);
+        if (persona == -1 || personality(persona | ADDR_NO_RANDOMIZE) == -1)
+            return "--randomize-layout";
+    }
+#   endif
+
+    return NULL;
+}
+
+
+
+//
+// Record the layout run executed in into vals (which must have NUM_METRICS
+// elements).
+//
+
+void layout_read(Conf *conf, Run *run, int64_t *vals)
+{
+    Layout *lay = &conf->layouts[run->layout];
+    vals[METRIC_LAYOUT] = run->layout + 1;
+    vals[METRIC_ENV_PAD] = lay->env_pad == -1 ? 0 : lay->env_pad;
+    vals[METRIC_ASLR] = !lay->no_aslr;
+    vals[METRIC_PWD_PAD] = lay->pwd_pad;
+}
+
+
+
+//
+// Estimate how much of the variance of cmd's (successful) real times is due
+// to the layout they executed in, storing the results in an.
+//
+
+void layout_anova(Cmd *cmd, Layout_Anova *an)
+{
+    int max_layout = 0;
+    for (int j = 0; j < cmd->num_runs; j += 1) {
+        if (cmd->samples[METRIC_LAYOUT][j] > max_layout)
+            max_layout = cmd->samples[METRIC_LAYOUT][j];
+    }
+    int ns[max_layout + 1];
+    double sums[max_layout + 1];
+    for (int l = 0; l <= max_layout; l += 1) {
+        ns[l] = 0;
+        sums[l] = 0;
+    }
+    int n = 0;
+    double sum = 0;
+    for (int j = 0; j < cmd->num_runs; j += 1) {
+        if (!RUN_IS_OK(cmd, j))
+            continue;
+        double x = cmd->samples[METRIC_REAL][j] / 1e9;
+        ns[cmd->samples[METRIC_LAYOUT][j]] += 1;
+        sums[cmd->samples[METRIC_LAYOUT][j]] += x;
+        n += 1;
+        sum += x;
+    }
+
+    // The sums of squares between and within layouts.
+    int k = 0;
+    double sum_n2 = 0, ssb = 0, ssw = 0;
+    for (int l = 1; l <= max_layout; l += 1) {
+        if (ns[l] == 0)
+            continue;
+        k += 1;
+        sum_n2 += (double) ns[l] * ns[l];
+        double d = sums[l] / ns[l] - sum / n;
+        ssb += ns[l] * d * d;
+    }
+    for (int j = 0; j < cmd->num_runs; j += 1) {
+        if (!RUN_IS_OK(cmd, j))
+            continue;
+        int l = cmd->samples[METRIC_LAYOUT][j];
+        double d = cmd->samples[METRIC_REAL][j] / 1e9 - sums[l] / ns[l];
+        ssw += d * d;
+    }
+
+    an->num_layouts = k;
+    if (k < 2 || n - k < 1) {
+        an->share = an->between_sd = an->within_sd = an->p = NAN;
+        return;
+    }
+    double msb = ssb / (k - 1), msw = ssw / (n - k);
+    // The (unbalanced) average number of runs per layout.
+    double n0 = (n - sum_n2 / n) / (k - 1);
+    double between = msb > msw ? (msb - msw) / n0 : 0;
+    an->between_sd = sqrt(between);
+    an->within_sd = sqrt(msw);
+    an->share = between + msw > 0 ? between / (between + msw) : 0;
+    if (msw == 0)
+        an->p = msb > 0 ? 0 : 1;
+    else {
+        double f = msb / msw, d1 = k - 1, d2 = n - k;
+        an->p = stats_incbeta(d2 / 2, d1 / 2, d2 / (d2 + d1 * f));
+    }
+}
+
+
+
+//
+// Return a copy of the environment, padded with a variable of pad bytes (if
+// pad isn't -1) and with PWD set to pwd (if it isn't NULL).
+//
+
+char **pad_env(int pad, const char *pwd)
+{
+    int n = 0;
+    while (environ[n] != NULL)
+        n += 1;
+    char **envp = malloc((n + 3) * sizeof(char *));
+    if (envp == NULL)
+        errx(1, "Out of memory.");
+    int m = 0;
+    for (int i = 0; i < n; i += 1) {
+        if (strncmp(environ[i], PAD_VAR "=", strlen(PAD_VAR) + 1) == 0
+          || (pwd != NULL && strncmp(environ[i], "PWD=", 4) == 0))
+            continue;
+        envp[m++] = environ[i];
+    }
+    if (pad != -1) {
+        char *var = malloc(strlen(PAD_VAR) + 1 + pad + 1);
+        if (var == NULL)
+            errx(1, "Out of memory.");
+        strcpy(var, PAD_VAR "=");
+        memset(var + strlen(var), 'x', pad);
+        var[strlen(PAD_VAR) + 1 + pad] = '\0';
+        envp[m++] = var;
+    }
+    if (pwd != NULL && asprintf(&envp[m++], "PWD=%s", pwd) == -1)
+        errx(1, "Out of memory.");
+    envp[m] = NULL;
+
+    return envp;
+}
+
+
+
+//
+// Return the path of the PWD symlink whose name is pad characters long.
+//
+
+char *pwd_link(int pad)
+{
+    char *path = malloc(strlen(pwd_dir) + 1 + pad + 1);
+    if (path == NULL)
+        errx(1, "Out of memory.");
+    strcpy(path, pwd_dir);
+    strcat(path, "/");
+    memset(path + strlen(path), '_', pad);
+    path[strlen(pwd_dir) + 1 + pad] = '\0';
+
+    return path;
+}
+
+
+
+//
+// Remove the PWD symlinks and their temporary directory.
+//
+
+void remove_pwds(void)
+{
+    for (int pad = 1; pad <= MAX_PWD_PAD; pad += 1) {
+        char *path = pwd_link(pad);
+        unlink(path);
+        free(path);
+    }
+    rmdir(pwd_dir);
+}
@@ -24,6 +24,7 @@
 #include <assert.h>
 #include <err.h>
 #include <errno.h>
+#include <getopt.h>
 #include <inttypes.h>
 #include <limits.h>
 #include <math.h>
@@ -36,47 +37,109 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "multitime.h"
 #include "format.h"
-
-
-
-#define BUFFER_SIZE (64 * 1024)
+#include "cgroup.h"
+#include "evict.h"
+#include "input.h"
+#include "outlier.h"
+#include "output.h"
+#include "isolate.h"
+#include "export.h"
+#include "layout.h"
+#include "perf.h"
+#include "sample.h"
+#include "schedule.h"
+#include "stats.h"
+#include "store.h"
+#include "stream.h"
+#include "sysmon.h"
+#include "sweep.h"
+#include "timeout.h"
+
+
+
+#define CONTROL_RUNS 5 // Max number of serial control runs per command for -j.
+#define CALIBRATION_RUNS 21 // Number of no-op runs used to measure overhead.
+#define MIN_ADAPTIVE_RUNS 3 // Min runs before a CI is considered narrow enough.
+
+// Long-only options, numbered so as not to clash with any short option.
+enum Long_Opt {OPT_BASELINE = 256, OPT_BOOTSTRAP, OPT_BOOTSTRAP_METHOD, OPT_CALIBRATE,
+  OPT_CGROUP, OPT_COMPARE_TO, OPT_CPUS, OPT_DIGEST, OPT_ENGINE, OPT_EVICT,
+  OPT_EXCLUDE_OUTLIERS, OPT_EXPORT_CSV, OPT_EXPORT_JSON, OPT_EXPORT_SAMPLES,
+  OPT_HISTOGRAM, OPT_INPUT_PIPE, OPT_IOPRIO, OPT_KEEP_GOING, OPT_LABEL,
+  OPT_MAX_RUNS, OPT_NICE, OPT_NOISE, OPT_NOISE_THRESHOLD, OPT_NUMA_NODE,
+  OPT_OUTLIERS, OPT_PARAM, OPT_PERCENTILES, OPT_PERF, OPT_RANDOMIZE_LAYOUT,
+  OPT_RANDOMIZE_PWD, OPT_RLIMIT, OPT_SAMPLE_INTERVAL, OPT_SCHED,
+  OPT_SCHEDULE, OPT_SEED, OPT_STORE, OPT_STREAM, OPT_TARGET_CI, OPT_THRESHOLD,
+  OPT_TIME_BUDGET, OPT_TIMEOUT, OPT_WAIT};
 
 
 extern char* __progname;
 
 void usage(int, char *);
-void execute_cmd(Conf *, Cmd *, int);
-FILE *read_input(Conf *, Cmd *, int);
-bool fcopy(FILE *, FILE *);
+void start_run(Conf *, Run *, int);
+void finish_run(Conf *, Run *, int, struct rusage *, struct timespec *);
+int devnull_fd(void);
+void resolve_path(Cmd *);
+void child_setup(Cmd *, Layout *, int *, int);
+void child_exec(Cmd *, Layout *);
+void launch(Conf *, Run *, int);
+uint64_t timespec_diff_ns(struct timespec *, struct timespec *);
+void calibrate(Conf *);
+int cmp_uint64(const void *, const void *);
+void execute_cmd(Conf *, Cmd *, int, bool, int);
+bool next_run(Conf *, Cmd **, int *);
+void update_converged(Conf *, Cmd *, double);
+void init_runs(Conf *, Cmd *);
+void grow_runs(Cmd *, int);
+void init_workers(Conf *);
+void execute_parallel(Conf *);
 char *replace(Conf *, Cmd *, const char *, int);
 char escape_char(char);
 
-#if defined(MT_HAVE_ARC4RANDOM)
-#define RANDN(n) (arc4random_uniform(n))
-#elif defined(MT_HAVE_DRAND48)
-#define RANDN(n) ((int) (drand48() * n))
-#elif defined(MT_HAVE_RANDOM)
-#define RANDN(n) (random() % n)
-#else
-#define RANDN(n) (rand() % n)
-#endif
-
 ////////////////////////////////////////////////////////////////////////////////
 // Running commands
 //
 
 #include <fcntl.h>
+#ifdef MT_HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
+#ifdef MT_HAVE_POSIX_SPAWN
+#include <spawn.h>
+#endif
+
+extern char **environ;
+
+const char *engine_names[] = {"fork", "vfork", "spawn", "prefork", NULL};
+const char *boot_method_names[] = {"percentile", "bca", NULL};
+
+#ifdef MT_HAVE_SCHED_SETAFFINITY
+// The disjoint set of CPUs that each parallel worker is pinned to.
+cpu_set_t *worker_cpus = NULL;
+#endif
 
-void execute_cmd(Conf *conf, Cmd *cmd, int runi)
+
+
+//
+// Set up everything run->cmd needs for run->runi and then start it, pinning
+// it to the CPUs of worker (if worker is -1, the run is not pinned).
+//
+
+void start_run(Conf *conf, Run *run, int worker)
 {
+    Cmd *cmd = run->cmd;
+    int runi = run->runi;
+
     if (conf->verbosity > 0) {
         fprintf(stderr, "===> Executing ");
-        pp_cmd(conf, cmd);
+        pp_cmd(stderr, conf, cmd);
         fprintf(stderr, "\n");
     }
 
@@ -87,145 +150,734 @@ void execute_cmd(Conf *conf, Cmd *cmd, int runi)
         free(pre_cmd);
     }
 
-    FILE *tmpf = NULL;
+    run->in_fd = -1;
     if (cmd->input_cmd)
-        tmpf = read_input(conf, cmd, runi);
+        input_open(conf, run, replace(conf, cmd, cmd->input_cmd, runi));
+
+    run->output_cmd = replace(conf, cmd, cmd->output_cmd, runi);
+    output_open(conf, run);
+
+    // Record the position in which this run was started.
+    if (!run->control && !conf->stream) {
+        cmd->orders[runi] = conf->num_started;
+        conf->num_started += 1;
+    }
+
+    if (conf->num_evict_files > 0) {
+        evict_prepare(conf, RUN_IS_COLD(runi));
+        run->cache_pre = evict_residency(conf);
+    }
+
+    run->layout = conf->num_layouts > 0 ? layout_pick(conf) : -1;
+
+    if (conf->noise)
+        sysmon_noise_start();
+    launch(conf, run, worker);
+}
+
+
+
+//
+// Return a file descriptor open for writing to /dev/null.
+//
+
+int devnull_fd(void)
+{
+    static int fd = -1;
+
+    if (fd == -1 && (fd = open("/dev/null", O_WRONLY | O_CLOEXEC)) == -1)
+        err(1, "Can't open /dev/null");
+
+    return fd;
+}
+
+
+
+//
+// Find the executable cmd->argv[0] would execute (searching PATH if it contains
+// no '/'), storing it in cmd->path. Doing this once, rather than having
+// execvp repeat it on every run, keeps the lookup out of the timings.
+//
+
+void resolve_path(Cmd *cmd)
+{
+    const char *name = cmd->argv[0];
+    if (strchr(name, '/') != NULL) {
+        cmd->path = strdup(name);
+        return;
+    }
 
-    FILE *outtmpf = NULL;
-    char *output_cmd = replace(conf, cmd, cmd->output_cmd, runi);
-    if (output_cmd) {
-        char outtmpp[] = "/tmp/mt.XXXXXXXXXX";
-        umask(S_IRWXG | S_IRWXO | S_IXUSR);
-        int outtmpfd = mkstemp(outtmpp);
-        if (outtmpfd != -1)
-            outtmpf = fdopen(outtmpfd, "r+");
-        if (outtmpfd == -1 || outtmpf == NULL)
-            errx(1, "Can't create temporary file.");
-	unlink(outtmpp);
+    const char *path = getenv("PATH");
+    if (path == NULL)
+        path = "/usr/bin:/bin";
+    while (true) {
+        const char *end = strchr(path, ':');
+        size_t dirlen = end ? (size_t) (end - path) : strlen(path);
+        char *cand;
+        if (dirlen == 0)
+            cand = strdup(name);
+        else if (asprintf(&cand, "%.*s/%s", (int) dirlen, path, name) == -1)
+            cand = NULL;
+        if (cand == NULL)
+            errx(1, "Out of memory.");
+        struct stat sb;
+        if (stat(cand, &sb) == 0 && S_ISREG(sb.st_mode)
+          && access(cand, X_OK) == 0) {
+            cmd->path = cand;
+            return;
+        }
+        free(cand);
+        if (end == NULL)
+            break;
+        path = end + 1;
     }
 
-    struct rusage *ru = cmd->rusages[runi] =
-      malloc(sizeof(struct rusage));
+    errx(1, "Can't find '%s' in PATH.", name);
+}
+
+
+
+//
+// In a newly created child: apply cmd's isolation settings (pinning ourselves
+// to worker's CPUs unless cmd specifies its own) and layout lay (NULL meaning
+// the default layout), and set up stdin, stdout, and stderr from fds (-1
+// meaning "leave as is"). As this may be called from a vfork'd child, it must
+// not touch any of the parent's memory. Errors are reported back to the parent
+// via our exit code.
+//
+
+void child_setup(Cmd *cmd, Layout *lay, int *fds, int worker)
+{
+    const char *failed = isolate_apply(&cmd->iso, worker);
+    if (failed == NULL && lay != NULL)
+        failed = layout_apply(lay);
+    if (failed != NULL) {
+        // We might be a vfork'd child, so we can't use stdio.
+        char pre[] = "multitime: Can't apply ", post[] = "\n";
+        struct iovec iov[] = {{pre, sizeof(pre) - 1},
+          {(char *) failed, strlen(failed)}, {post, sizeof(post) - 1}};
+        ssize_t r = writev(STDERR_FILENO, iov, 3);
+        (void) r;
+        _exit(1);
+    }
+
+    for (int i = 0; i < 3; i += 1) {
+        if (fds[i] != -1 && dup2(fds[i], i) == -1)
+            _exit(1);
+    }
+}
+
+
+
+//
+// In a child set up by child_setup: execute cmd with lay's environment (if lay
+// isn't NULL).
+//
+
+void child_exec(Cmd *cmd, Layout *lay)
+{
+    if (lay != NULL)
+        execve(cmd->path, cmd->argv, lay->envp);
+    else
+        execv(cmd->path, cmd->argv);
+    _exit(1);
+}
+
+
+
+//
+// Start run->cmd using conf->engine, pinned to the CPUs of worker (if worker
+// is -1, the run is not pinned). run->startt is set to the time from which the
+// run is timed.
+//
+
+void launch(Conf *conf, Run *run, int worker)
+{
+    Cmd *cmd = run->cmd;
+
+    if (cmd->path == NULL)
+        resolve_path(cmd);
+
+    for (int i = 0; i < NUM_PERF_EVENTS; i += 1)
+        run->perf_fds[i] = -1;
+    run->cgroup = NULL;
+    run->pidfd = -1;
+    Layout *lay = run->layout == -1 ? NULL : &conf->layouts[run->layout];
+
+    // Work out the child's stdin, stdout, and stderr up front, so that the
+    // child need do nothing more than dup2 them.
+    int fds[3] = {-1, -1, -1};
+    fds[STDIN_FILENO] = run->in_fd;
+    if (run->out_fd != -1)
+        fds[STDOUT_FILENO] = run->out_fd;
+    else if (cmd->quiet_stdout)
+        fds[STDOUT_FILENO] = devnull_fd();
+    if (cmd->quiet_stderr)
+        fds[STDERR_FILENO] = devnull_fd();
 
     // Note: we want to do as little stuff in either parent or child between the
-    // two gettimeofday calls, otherwise we might interfere with the timings.
+    // two clock_gettime calls, otherwise we might interfere with the timings.
+
+    pid_t pid;
+    switch (conf->engine) {
+        case ENGINE_FORK:
+            clock_gettime(MT_CLOCK, &run->startt);
+            pid = fork();
+            if (pid == 0) {
+                child_setup(cmd, lay, fds, worker);
+                child_exec(cmd, lay);
+            }
+            break;
+        case ENGINE_VFORK:
+#           ifdef MT_HAVE_VFORK
+            clock_gettime(MT_CLOCK, &run->startt);
+            pid = vfork();
+            if (pid == 0) {
+                child_setup(cmd, lay, fds, worker);
+                child_exec(cmd, lay);
+            }
+            break;
+#           else
+            errx(1, "vfork is not supported on this platform.");
+#           endif
+        case ENGINE_SPAWN: {
+#           ifdef MT_HAVE_POSIX_SPAWN
+            posix_spawn_file_actions_t fa;
+            posix_spawn_file_actions_init(&fa);
+            // A run with a timeout gets its own process group (see
+            // timeout.c).
+            posix_spawnattr_t attr;
+            posix_spawnattr_init(&attr);
+            if (cmd->iso.timeout > 0) {
+                posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+                posix_spawnattr_setpgroup(&attr, 0);
+            }
+            for (int i = 0; i < 3; i += 1) {
+                if (fds[i] != -1)
+                    posix_spawn_file_actions_adddup2(&fa, fds[i], i);
+            }
+            // posix_spawn has no way of setting the child's affinity, so we
+            // temporarily pin ourselves and let the child inherit it.
+#           ifdef MT_HAVE_SCHED_SETAFFINITY
+            cpu_set_t old_cpus;
+            if (worker >= 0) {
+                sched_getaffinity(0, sizeof(cpu_set_t), &old_cpus);
+                sched_setaffinity(0, sizeof(cpu_set_t), &worker_cpus[worker]);
+            }
+#           endif
+            clock_gettime(MT_CLOCK, &run->startt);
+            int rtn = posix_spawn(&pid, cmd->path, &fa, &attr, cmd->argv,
+              lay != NULL ? lay->envp : environ);
+#           ifdef MT_HAVE_SCHED_SETAFFINITY
+            if (worker >= 0)
+                sched_setaffinity(0, sizeof(cpu_set_t), &old_cpus);
+#           endif
+            posix_spawn_file_actions_destroy(&fa);
+            posix_spawnattr_destroy(&attr);
+            if (rtn != 0) {
+                errno = rtn;
+                err(1, "Can't spawn %s", cmd->path);
+            }
+            break;
+#           else
+            errx(1, "posix_spawn is not supported on this platform.");
+#           endif
+        }
+        case ENGINE_PREFORK: {
+            // The child sets itself up fully, tells us it's ready, and then
+            // blocks until we release it: only then do we start the clock.
+            int ready[2], gate[2];
+            if (pipe(ready) == -1 || pipe(gate) == -1)
+                err(1, "Can't create pipe");
+            pid = fork();
+            if (pid == 0) {
+                close(ready[0]);
+                close(gate[1]);
+                child_setup(cmd, lay, fds, worker);
+                char c;
+                if (write(ready[1], "", 1) != 1 || read(gate[0], &c, 1) != 1)
+                    _exit(1);
+                close(ready[1]);
+                close(gate[0]);
+                child_exec(cmd, lay);
+            }
+            close(ready[1]);
+            close(gate[0]);
+            char c;
+            if (pid != -1 && read(ready[0], &c, 1) != 1)
+                errx(1, "Error when attempting to run %s", cmd->argv[0]);
+            if (pid != -1 && conf->cgroup && !run->control)
+                cgroup_enter(conf, run, pid);
+            if (pid != -1 && conf->perf && !run->control)
+                perf_open(conf, run, pid);
+            clock_gettime(MT_CLOCK, &run->startt);
+            if (pid != -1 && write(gate[1], "", 1) != 1)
+                errx(1, "Error when attempting to run %s", cmd->argv[0]);
+            close(ready[0]);
+            close(gate[1]);
+            break;
+        }
+        default:
+            abort();
+    }
+    if (pid == -1)
+        err(1, "Can't fork");
+
+    run->pid = pid;
+    timeout_start(run);
+    if (conf->sample_interval > 0 && !run->control)
+        sample_start(conf, run);
+}
+
+
 
-    struct timeval startt;
-    gettimeofday(&startt, NULL);
-    pid_t pid = fork();
-    if (pid == 0) {
-        // Child. Note we don't deal with errors directly here, but simply report
-        // them back to the parent, which will then exit.
-        if (tmpf && dup2(fileno(tmpf), STDIN_FILENO) == -1)
-            exit(1);
+//
+// Return the number of nanoseconds from start to end.
+//
+
+uint64_t timespec_diff_ns(struct timespec *start, struct timespec *end)
+{
+    return (uint64_t) (end->tv_sec - start->tv_sec) * 1000000000
+      + end->tv_nsec - start->tv_nsec;
+}
+
+
+
+//
+// Time how long conf->engine takes to launch and reap a command which does
+// nothing at all, storing the median of CALIBRATION_RUNS such runs in
+// conf->overhead.
+//
 
-        if (cmd->quiet_stdout && freopen("/dev/null", "w", stdout) == NULL)
-            exit(1);
-        if (cmd->quiet_stderr && freopen("/dev/null", "w", stderr) == NULL)
-            exit(1);
-        else if (output_cmd && dup2(fileno(outtmpf), STDOUT_FILENO) == -1)
-            exit(1);
-        execvp(cmd->argv[0], cmd->argv);
-        exit(1);
+void calibrate(Conf *conf)
+{
+    char *argv[] = {"true", NULL};
+    Cmd cmd = {.argv = argv};
+    uint64_t times[CALIBRATION_RUNS];
+
+    // The first run is purely to warm up caches, and isn't recorded.
+    for (int i = -1; i < CALIBRATION_RUNS; i += 1) {
+        Run run = {.cmd = &cmd, .control = true, .in_fd = -1, .out_fd = -1,
+          .layout = -1};
+        launch(conf, &run, conf->jobs > 1 ? 0 : -1);
+        int status;
+        struct rusage ru;
+        wait4(run.pid, &status, 0, &ru);
+        struct timespec endt;
+        clock_gettime(MT_CLOCK, &endt);
+        if (status != 0)
+            errx(1, "Error when attempting to run %s", cmd.path);
+        if (i >= 0)
+            times[i] = timespec_diff_ns(&run.startt, &endt);
     }
+    free(cmd.path);
 
-    // Parent
+    qsort(times, CALIBRATION_RUNS, sizeof(uint64_t), cmp_uint64);
+    conf->overhead = times[CALIBRATION_RUNS / 2];
+}
 
-    int status;
-    wait4(pid, &status, 0, ru);
-    struct timeval endt;
-    gettimeofday(&endt, NULL);
 
-    if (status != 0)
-        errx(status, "Error when attempting to run %s", cmd->argv[0]);
 
-    if (tmpf)
-        fclose(tmpf);
+int cmp_uint64(const void *x, const void *y)
+{
+    uint64_t a = *((const uint64_t *) x), b = *((const uint64_t *) y);
+
+    if (a < b)
+        return -1;
+    else if (a == b)
+        return 0;
+    return 1;
+}
+
+
 
-    struct timeval *tv = cmd->timevals[runi] = malloc(sizeof(struct timeval));
-    timersub(&endt, &startt, tv);
+//
+// Record the results of a run which has been reaped at time endt with exit
+// status 'status' and resource usage 'ru'.
+//
 
-    // If an output command is specified, pipe the temporary output to it, and
-    // check its return code.
+void finish_run(Conf *conf, Run *run, int status, struct rusage *ru,
+  struct timespec *endt)
+{
+    Cmd *cmd = run->cmd;
+
+    enum Run_State state = STATE_OK;
+    if (timeout_finish(run))
+        state = STATE_TIMED_OUT;
+    else if (status != 0) {
+        // Exit as a shell would if the command had been run directly.
+        if (!conf->keep_going && WIFSIGNALED(status))
+            errx(128 + WTERMSIG(status),
+              "Exiting because %s was killed by signal %d.", cmd->argv[0],
+              WTERMSIG(status));
+        else if (!conf->keep_going)
+            errx(WEXITSTATUS(status), "Exiting because %s exited with %d.",
+              cmd->argv[0], WEXITSTATUS(status));
+        state = STATE_FAILED;
+    }
 
-    if (output_cmd) {
-        fflush(outtmpf);
-        fseek(outtmpf, 0, SEEK_SET);
-        FILE *cmdf = popen(output_cmd, "w");
-        if (cmdf == NULL || !fcopy(outtmpf, cmdf))
-            errx(1, "Error when attempting to run %s", output_cmd);
-        if (pclose(cmdf) != 0)
-            errx(1, "Exiting because '%s' failed.", output_cmd);
-        fclose(outtmpf);
-        free(output_cmd);
+    input_close(run);
+
+    int64_t ns = timespec_diff_ns(&run->startt, endt);
+    // A timed out run is only known to take longer than the timeout.
+    if (state == STATE_TIMED_OUT)
+        ns = (int64_t) (cmd->iso.timeout * 1000000000);
+    else if (conf->calibrate == CALIBRATE_SUBTRACT) {
+        // The overhead is itself only an estimate, so a run may come out
+        // faster than it. Clamping such runs to 0 would bias the mean and
+        // shrink the variance, so they're left negative, and reported.
+        ns -= (int64_t) conf->overhead;
+        if (ns < 0 && !run->control)
+            conf->num_below_overhead += 1;
+    }
+    if (run->control)
+        cmd->ctrl_reals[run->runi] = ns;
+    else {
+        int64_t vals[NUM_METRICS];
+        run_metrics(ns, ru, vals);
+        if (conf->perf)
+            perf_read(conf, run, vals);
+        if (conf->cgroup)
+            cgroup_read(conf, run, vals);
+        if (conf->sample_interval > 0)
+            sample_finish(conf, run, vals);
+        if (conf->noise)
+            sysmon_noise_read(vals);
+        if (conf->num_layouts > 0)
+            layout_read(conf, run, vals);
+        if (conf->num_evict_files > 0) {
+            vals[METRIC_CACHE_PRE] = run->cache_pre;
+            vals[METRIC_CACHE_POST] = evict_residency(conf);
+        }
+        if (conf->stream) {
+            if (state == STATE_OK)
+                stream_add_run(cmd->streams, vals);
+        }
+        else {
+            for (enum Metric m = 0; m < NUM_METRICS; m += 1)
+                cmd->samples[m][run->runi] = vals[m];
+            cmd->states[run->runi] = state;
+        }
+        if (state == STATE_FAILED)
+            cmd->num_failed += 1;
+        else if (state == STATE_TIMED_OUT)
+            cmd->num_timed_out += 1;
+        if (state == STATE_OK && conf->noise
+          && vals[METRIC_NOISE] > conf->noise_threshold * 100) {
+            cmd->num_noisy += 1;
+            cmd->noisy_real += (double) ns / 1000000000;
+        }
+        if (state == STATE_OK)
+            update_converged(conf, cmd, (double) ns / 1000000000);
+        else if (cmd->num_failed + cmd->num_timed_out > cmd->num_done
+          && cmd->num_failed + cmd->num_timed_out >= MIN_ADAPTIVE_RUNS) {
+            // Unsuccessful runs don't narrow the CI, so a command whose runs
+            // mostly fail would otherwise never converge in adaptive mode.
+            cmd->converged = true;
+        }
     }
 
-    return;
+    // If stdout was captured, digest it and/or pipe it to the output command.
+
+    uint64_t digest;
+    output_finish(conf, run, &digest);
+    if (conf->digest) {
+        if (cmd->num_digested == 0)
+            cmd->digest = digest;
+        else if (digest != cmd->digest)
+            cmd->num_digest_diffs += 1;
+        cmd->num_digested += 1;
+        if (!run->control && !conf->stream)
+            cmd->digests[run->runi] = digest;
+    }
+
+    run->pid = 0;
 }
 
 
 
 //
-// Read in the input from cmd->input_cmd for runi and return an open file set
-// to read from the beginning which contains its output.
+// Execute run runi of cmd and wait for it to finish. If control is true, the
+// run is recorded as part of cmd's serial control sample.
 //
 
-FILE *read_input(Conf *conf, Cmd *cmd, int runi)
+void execute_cmd(Conf *conf, Cmd *cmd, int runi, bool control, int worker)
 {
-    assert(cmd->input_cmd);
-
-    char *input_cmd = replace(conf, cmd, cmd->input_cmd, runi);
-    FILE *cmdf = popen(input_cmd, "r");
-    if (!cmdf)
-        goto cmd_err;
-    char tmpp[] = "/tmp/mt.XXXXXXXXXX";
-    umask(S_IRWXG | S_IRWXO | S_IXUSR);
-    int tmpfd = mkstemp(tmpp);
-    if (tmpfd == -1)
-        goto cmd_err;
-    FILE *tmpf = fdopen(tmpfd, "r+");
-    if (!tmpf)
-        goto cmd_err;
-
-    fcopy(cmdf, tmpf);
-    if (pclose(cmdf) != 0)
-        goto cmd_err;
-    free(input_cmd);
-    fseek(tmpf, 0, SEEK_SET);
-    unlink(tmpp);
-
-    return tmpf;
-
-cmd_err:
-    errx(1, "Error when attempting to run %s.", cmd->input_cmd);
+    Run run = {.cmd = cmd, .runi = runi, .control = control};
+    start_run(conf, &run, worker);
+
+    if (run.pidfd != -1)
+        sample_wait(conf, &run, 1);
+    int status;
+    struct rusage ru;
+    timeout_wait4(run.pid, &status, 0, &ru);
+    struct timespec endt;
+    clock_gettime(MT_CLOCK, &endt);
+    if (conf->noise)
+        sysmon_noise_finish();
+
+    finish_run(conf, &run, status, &ru, &endt);
 }
 
 
 
 //
-// Copy all data from rf to wf. Returns true if successful, false if not.
+// Pick the next run to start, storing its command and run number in *cmdp and
+// *runip. Returns false if there are no more runs to start.
 //
 
-bool fcopy(FILE *rf, FILE *wf)
+bool next_run(Conf *conf, Cmd **cmdp, int *runip)
 {
-    char *buf = malloc(BUFFER_SIZE);
-    while (1) {
-        size_t r = fread(buf, 1, BUFFER_SIZE, rf);
-        if (r < BUFFER_SIZE && ferror(rf)) {
-            free(buf);
+    if (!conf->adaptive) {
+        if (!schedule_next(conf, cmdp))
             return false;
+        *runip = (*cmdp)->num_started;
+        (*cmdp)->num_started += 1;
+        return true;
+    }
+
+    // In adaptive mode, we keep starting runs of any command whose confidence
+    // interval is not yet narrow enough, until it reaches conf->max_runs or the
+    // time budget is exhausted. Every command gets at least one run, so that
+    // there is always something to report.
+
+    bool over_budget = false;
+    if (conf->time_budget > 0) {
+        struct timespec now;
+        clock_gettime(MT_CLOCK, &now);
+        over_budget = timespec_diff_ns(&conf->start_time, &now)
+          >= conf->time_budget * 1000000000;
+    }
+
+    // Pick from the commands which still need runs (for random schedules,
+    // with equal probability).
+    int left[conf->num_cmds];
+    bool any = false;
+    for (int i = 0; i < conf->num_cmds; i += 1) {
+        Cmd *cmd = conf->cmds[i];
+        left[i] = cmd->num_started == 0 || (!over_budget && !cmd->converged
+          && cmd->num_started < conf->max_runs);
+        if (left[i] > 0)
+            any = true;
+    }
+    if (!any)
+        return false;
+
+    Cmd *cmd = conf->cmds[schedule_pick(conf, left)];
+    if (!conf->stream)
+        grow_runs(cmd, cmd->num_started + 1);
+    *cmdp = cmd;
+    *runip = cmd->num_started;
+    cmd->num_started += 1;
+    cmd->num_runs = cmd->num_started;
+
+    return true;
+}
+
+
+
+//
+// Update cmd's running mean and variance of real times with a newly finished
+// run which took 'secs' seconds and, in adaptive mode, check whether its
+// confidence interval is now narrow enough for it to need no more runs.
+//
+
+void update_converged(Conf *conf, Cmd *cmd, double secs)
+{
+    cmd->num_done += 1;
+    double delta = secs - cmd->real_mean;
+    cmd->real_mean += delta / cmd->num_done;
+    cmd->real_m2 += delta * (secs - cmd->real_mean);
+
+    if (conf->target_ci == 0 || cmd->num_done < conf->num_runs
+      || cmd->num_done < MIN_ADAPTIVE_RUNS)
+        return;
+
+    double ci = z_t(conf, cmd->num_done) * sqrt(cmd->real_m2 / cmd->num_done)
+      / sqrt(cmd->num_done);
+    if (ci <= cmd->real_mean * conf->target_ci / 100)
+        cmd->converged = true;
+}
+
+
+
+//
+// Set up cmd's storage for recording runs.
+//
+
+void init_runs(Conf *conf, Cmd *cmd)
+{
+    for (enum Metric m = 0; m < NUM_METRICS; m += 1)
+        cmd->samples[m] = NULL;
+    cmd->orders = NULL;
+    cmd->digests = NULL;
+    cmd->states = NULL;
+    cmd->num_failed = cmd->num_timed_out = 0;
+    cmd->num_noisy = 0;
+    cmd->noisy_real = 0;
+    cmd->stored = NULL;
+    cmd->outliers = NULL;
+    cmd->runs_cap = 0;
+    cmd->streams = NULL;
+    if (conf->stream) {
+        if ((cmd->streams = malloc(sizeof(Stream) * NUM_METRICS)) == NULL)
+            errx(1, "Out of memory.");
+        for (enum Metric m = 0; m < NUM_METRICS; m += 1)
+            stream_init(&cmd->streams[m]);
+    }
+    else
+        grow_runs(cmd, conf->num_runs);
+    cmd->ctrl_reals = malloc(sizeof(int64_t) * conf->num_ctrl_runs);
+    if (cmd->ctrl_reals == NULL)
+        errx(1, "Out of memory.");
+    // In adaptive mode, runs are added as they are started.
+    cmd->num_runs = conf->adaptive ? 0 : conf->num_runs;
+    cmd->num_started = cmd->num_done = 0;
+    cmd->real_mean = cmd->real_m2 = 0;
+    cmd->converged = false;
+    cmd->num_digested = cmd->num_digest_diffs = 0;
+    cmd->boot_ests = cmd->boot_los = cmd->boot_his = NULL;
+}
+
+
+
+//
+// Ensure that cmd has room to record at least n runs.
+//
+
+void grow_runs(Cmd *cmd, int n)
+{
+    if (n <= cmd->runs_cap)
+        return;
+
+    int cap = cmd->runs_cap;
+    if (cap == 0)
+        cap = 1;
+    while (cap < n)
+        cap = cap > INT_MAX / 2 ? INT_MAX : cap * 2;
+    for (enum Metric m = 0; m < NUM_METRICS; m += 1) {
+        cmd->samples[m] = realloc(cmd->samples[m], sizeof(int64_t) * cap);
+        if (cmd->samples[m] == NULL)
+            errx(1, "Out of memory.");
+    }
+    cmd->orders = realloc(cmd->orders, sizeof(int) * cap);
+    cmd->digests = realloc(cmd->digests, sizeof(uint64_t) * cap);
+    cmd->states = realloc(cmd->states, sizeof(enum Run_State) * cap);
+    if (cmd->orders == NULL || cmd->digests == NULL || cmd->states == NULL)
+        errx(1, "Out of memory.");
+    for (int j = cmd->runs_cap; j < cap; j += 1)
+        cmd->orders[j] = -1;
+    cmd->runs_cap = cap;
+}
+
+
+
+//
+// Divide the CPUs multitime is allowed to run on into conf->jobs disjoint
+// sets, one per worker.
+//
+
+void init_workers(Conf *conf)
+{
+#   ifdef MT_HAVE_SCHED_SETAFFINITY
+    cpu_set_t avail;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &avail) == -1)
+        err(1, "Can't determine the available CPUs");
+    int ncpus = CPU_COUNT(&avail);
+    if (conf->jobs > ncpus)
+        errx(1, "Can't run %d jobs in parallel on %d CPUs.", conf->jobs, ncpus);
+
+    worker_cpus = malloc(sizeof(cpu_set_t) * conf->jobs);
+    if (worker_cpus == NULL)
+        errx(1, "Out of memory.");
+    int cpus_per_worker = ncpus / conf->jobs;
+    int cpu = 0;
+    for (int w = 0; w < conf->jobs; w += 1) {
+        CPU_ZERO(&worker_cpus[w]);
+        for (int k = 0; k < cpus_per_worker; k += 1) {
+            while (!CPU_ISSET(cpu, &avail))
+                cpu += 1;
+            CPU_SET(cpu, &worker_cpus[w]);
+            cpu += 1;
         }
-        size_t w = fwrite(buf, 1, r, wf);
-        if (w < r && ferror(wf)) {
-            free(buf);
-            return false;
+    }
+#   endif
+}
+
+
+
+//
+// Execute every run of every command, keeping up to conf->jobs runs going at
+// once. Before doing so, a short serial control sample of each command is
+// taken (on worker 0's CPUs), so that we can report whether running in
+// parallel has shifted the timings.
+//
+
+void execute_parallel(Conf *conf)
+{
+    for (int i = 0; i < conf->num_cmds; i += 1) {
+        for (int j = 0; j < conf->num_ctrl_runs; j += 1) {
+            execute_cmd(conf, conf->cmds[i], j, true, 0);
+            sysmon_pause(conf);
         }
-        if (feof(rf))
-            break;
     }
-    free(buf);
 
-    return true;
+    Run *runs = calloc(conf->jobs, sizeof(Run));
+    if (runs == NULL)
+        errx(1, "Out of memory.");
+    int num_running = 0;
+    while (true) {
+        // Keep every worker busy. Note that we can't sleep between runs here,
+        // as that would delay reaping those which are still executing.
+        if (num_running < conf->jobs) {
+            int w = 0;
+            while (runs[w].pid != 0)
+                w += 1;
+            if (next_run(conf, &runs[w].cmd, &runs[w].runi)) {
+                runs[w].control = false;
+                start_run(conf, &runs[w], w);
+                num_running += 1;
+                continue;
+            }
+        }
+        if (num_running == 0)
+            break;
+
+        // Reap every run which has finished before recording any of them, so
+        // that the time spent in finish_run (e.g. running output commands)
+        // doesn't inflate other runs' timings.
+        pid_t pids[conf->jobs];
+        int statuses[conf->jobs];
+        struct rusage rus[conf->jobs];
+        struct timespec endts[conf->jobs];
+        int num_reaped = 0;
+        int options = 0;
+        if (conf->sample_interval > 0)
+            sample_wait(conf, runs, conf->jobs);
+        while (num_reaped < num_running) {
+            pid_t pid = timeout_wait4(-1, &statuses[num_reaped], options,
+              &rus[num_reaped]);
+            if (pid == 0)
+                break;
+            if (pid == -1)
+                err(1, "Error when waiting for a run to finish");
+            clock_gettime(MT_CLOCK, &endts[num_reaped]);
+            pids[num_reaped] = pid;
+            num_reaped += 1;
+            options = WNOHANG;
+        }
+
+        for (int k = 0; k < num_reaped; k += 1) {
+            for (int w = 0; w < conf->jobs; w += 1) {
+                if (runs[w].pid == pids[k]) {
+                    finish_run(conf, &runs[w], statuses[k], &rus[k], &endts[k]);
+                    num_running -= 1;
+                    break;
+                }
+            }
+        }
+    }
+    free(runs);
 }
 
 
@@ -447,12 +1099,11 @@ void parse_batch(Conf *conf, char *path)
         }
 
         Cmd *cmd = malloc(sizeof(Cmd));
+        cmd->path = NULL;
         cmd->pre_cmd = cmd->input_cmd = cmd->output_cmd = cmd->replace_str = NULL;
         cmd->quiet_stdout = cmd->quiet_stderr = false;
-        cmd->rusages = malloc(sizeof(struct rusage *) * conf->num_runs);
-        cmd->timevals = malloc(sizeof(struct timeval *) * conf->num_runs);
-        memset(cmd->rusages, 0, sizeof(struct rusage *) * conf->num_runs);
-        memset(cmd->timevals, 0, sizeof(struct rusage *) * conf->num_runs);
+        memset(&cmd->iso, 0, sizeof(Isolation));
+        cmd->param_vals = NULL;
         int j = 0;
         while (j < argc) {
             if (strcmp(argv[j], "-I") == 0) {
@@ -490,6 +1141,17 @@ void parse_batch(Conf *conf, char *path)
                 free(argv[j]);
                 j += 2;
             }
+            else if (strncmp(argv[j], "--", 2) == 0 && strlen(argv[j]) > 2) {
+                if (j + 1 == argc)
+                    errx(1, "option requires an argument -- %s at line %d",
+                      argv[j] + 2, lineno);
+                const char *msg = isolate_parse(&cmd->iso, argv[j] + 2,
+                  argv[j + 1]);
+                if (msg != NULL)
+                    errx(1, "%s at line %d: %s", argv[j], lineno, msg);
+                free(argv[j]);
+                j += 2;
+            }
             else if (strlen(argv[j]) > 0 && argv[j][0] == '-') {
                 if (strlen(argv[j]) == 1)
                     errx(1, "option name not given -- at line %d", lineno);
@@ -549,10 +1211,42 @@ void usage(int rtn_code, char *msg)
     if (msg)
         fprintf(stderr, "%s\n", msg);
     fprintf(stderr, "Usage:\n  %s [-c <level>] [-f <liketime|rusage>] [-I <replstr>]\n"
-      "    [-i <stdincmd>] [-n <numruns> [-o <stdoutcmd>] [-q] [-s <sleep>]\n"
+      "    [-i <stdincmd>] [-j <jobs>] [-n <numruns> [-o <stdoutcmd>] [-q]\n"
+      "    [-s <sleep>] [--bootstrap <resamples>]\n"
+      "    [--bootstrap-method <percentile|bca>] [--calibrate <report|subtract>]\n"
+      "    [--cgroup <dir>] [--compare-to <label>] [--cpus <cpulist>] [--digest]\n"
+      "    [--engine <fork|vfork|spawn|prefork>] [--evict <path>]\n"
+      "    [--exclude-outliers] [--export-csv <file>] [--export-json <file>]\n"
+      "    [--export-samples <file>] [--histogram] [--input-pipe]\n"
+      "    [--ioprio <class[:level]>] [--keep-going] [--label <label>]\n"
+      "    [--max-runs <maxruns>] [--nice <nice>] [--noise]\n"
+      "    [--noise-threshold <percent>] [--numa-node <node>]\n"
+      "    [--outliers <tukey|mad>] [--param <name=values>]\n"
+      "    [--percentiles <p1,...,pn>] [--perf] [--randomize-layout]\n"
+      "    [--randomize-pwd] [--rlimit <resource=value>]\n"
+      "    [--sample-interval <secs>] [--sched <policy[:prio]>]\n"
+      "    [--schedule <random|interleave|block|abba>] [--seed <seed>]\n"
+      "    [--store <file>] [--stream] [--target-ci <percent>]\n"
+      "    [--threshold <percent>] [--time-budget <secs>] [--timeout <secs>]\n"
+      "    [--wait <random|quiesce>]\n"
       "    <command> [<arg 1> ... <arg n>]\n"
-      "  %s -b <file> [-c <level>] [-f <rusage>] [-s <sleep>]\n"
-      "    [-n <numruns>]\n", __progname, __progname);
+      "  %s -b <file> [-c <level>] [-f <rusage>] [-j <jobs>] [-s <sleep>]\n"
+      "    [-n <numruns>] [--baseline <cmdnum>] [--bootstrap <resamples>]\n"
+      "    [--bootstrap-method <percentile|bca>] [--calibrate <report|subtract>]\n"
+      "    [--cgroup <dir>] [--compare-to <label>] [--digest]\n"
+      "    [--engine <fork|vfork|spawn|prefork>] [--evict <path>]\n"
+      "    [--exclude-outliers] [--export-csv <file>] [--export-json <file>]\n"
+      "    [--export-samples <file>] [--histogram] [--input-pipe]\n"
+      "    [--keep-going] [--label <label>] [--max-runs <maxruns>] [--noise]\n"
+      "    [--noise-threshold <percent>] [--outliers <tukey|mad>]\n"
+      "    [--param <name=values>]\n"
+      "    [--percentiles <p1,...,pn>] [--perf] [--randomize-layout]\n"
+      "    [--randomize-pwd]\n"
+      "    [--sample-interval <secs>] [--schedule <random|interleave|block|abba>]\n"
+      "    [--seed <seed>] [--store <file>] [--stream] [--target-ci <percent>]\n"
+      "    [--threshold <percent>] [--time-budget <secs>]\n"
+      "    [--wait <random|quiesce>]\n",
+      __progname, __progname);
     exit(rtn_code);
 }
 
@@ -562,16 +1256,108 @@ int main(int argc, char** argv)
 {
     Conf *conf = malloc(sizeof(Conf));
     conf->num_runs = 1;
+    conf->jobs = 1;
     conf->format_style = FORMAT_UNKNOWN;
+    conf->engine = ENGINE_FORK;
+    conf->calibrate = CALIBRATE_NONE;
+    conf->num_below_overhead = 0;
+    conf->perf = conf->perf_hw = false;
+    conf->cgroup = NULL;
+    conf->adaptive = false;
+    conf->target_ci = 0;
+    conf->max_runs = INT_MAX;
+    conf->time_budget = 0;
+    conf->num_started = 0;
+    conf->schedule = SCHEDULE_RANDOM;
+    conf->has_seed = false;
+    conf->sched = NULL;
+    conf->stream = false;
+    conf->params = NULL;
+    conf->num_params = 0;
+    conf->sweeps = NULL;
+    conf->num_sweeps = 0;
+    conf->baseline = -1;
+    conf->bootstrap = 0;
+    conf->boot_method = BOOT_BCA;
+    conf->outliers = OUTLIERS_NONE;
+    conf->exclude_outliers = false;
+    conf->histogram = false;
+    conf->percentiles = NULL;
+    conf->num_percentiles = 0;
+    conf->export_json = conf->export_csv = NULL;
+    conf->input_pipe = false;
+    conf->digest = false;
+    conf->keep_going = false;
+    conf->noise = false;
+    conf->noise_threshold = 10;
+    conf->randomize_layout = conf->randomize_pwd = false;
+    conf->layouts = NULL;
+    conf->num_layouts = 0;
+    conf->sample_interval = 0;
+    conf->export_samples = NULL;
+    conf->store = conf->compare_to = NULL;
+    conf->label = "default";
+    conf->threshold = 0;
+    conf->evict_files = NULL;
+    conf->num_evict_files = 0;
     conf->sleep = 3;
+    conf->wait = WAIT_RANDOM;
     conf->verbosity = 0;
     conf->conf_level = 99;
 
-    bool quiet_stdout = false, quiet_stderr = false;
+    bool quiet_stdout = false, quiet_stderr = false, engine_set = false;
+    bool label_set = false, threshold_set = false;
     char *batch_file = NULL;
     char *pre_cmd = NULL, *input_cmd = NULL, *output_cmd = NULL, *replace_str = NULL;
-    int ch;
-    while ((ch = getopt(argc, argv, "+b:c:f:hi:ln:I:o:pqr:s:v")) != -1) {
+    Isolation iso = {0};
+    static struct option longopts[] = {
+        {"baseline",  required_argument, NULL, OPT_BASELINE},
+        {"bootstrap", required_argument, NULL, OPT_BOOTSTRAP},
+        {"bootstrap-method", required_argument, NULL, OPT_BOOTSTRAP_METHOD},
+        {"calibrate", required_argument, NULL, OPT_CALIBRATE},
+        {"cgroup",    required_argument, NULL, OPT_CGROUP},
+        {"compare-to", required_argument, NULL, OPT_COMPARE_TO},
+        {"cpus",      required_argument, NULL, OPT_CPUS},
+        {"digest",    no_argument,       NULL, OPT_DIGEST},
+        {"engine",    required_argument, NULL, OPT_ENGINE},
+        {"evict",     required_argument, NULL, OPT_EVICT},
+        {"exclude-outliers", no_argument, NULL, OPT_EXCLUDE_OUTLIERS},
+        {"export-csv", required_argument, NULL, OPT_EXPORT_CSV},
+        {"export-json", required_argument, NULL, OPT_EXPORT_JSON},
+        {"export-samples", required_argument, NULL, OPT_EXPORT_SAMPLES},
+        {"histogram", no_argument,       NULL, OPT_HISTOGRAM},
+        {"input-pipe", no_argument,      NULL, OPT_INPUT_PIPE},
+        {"ioprio",    required_argument, NULL, OPT_IOPRIO},
+        {"keep-going", no_argument,      NULL, OPT_KEEP_GOING},
+        {"label",     required_argument, NULL, OPT_LABEL},
+        {"max-runs",  required_argument, NULL, OPT_MAX_RUNS},
+        {"nice",      required_argument, NULL, OPT_NICE},
+        {"noise",     no_argument,       NULL, OPT_NOISE},
+        {"noise-threshold", required_argument, NULL, OPT_NOISE_THRESHOLD},
+        {"numa-node", required_argument, NULL, OPT_NUMA_NODE},
+        {"outliers",  required_argument, NULL, OPT_OUTLIERS},
+        {"param",     required_argument, NULL, OPT_PARAM},
+        {"percentiles", required_argument, NULL, OPT_PERCENTILES},
+        {"perf",      no_argument,       NULL, OPT_PERF},
+        {"randomize-layout", no_argument, NULL, OPT_RANDOMIZE_LAYOUT},
+        {"randomize-pwd", no_argument,   NULL, OPT_RANDOMIZE_PWD},
+        {"rlimit",    required_argument, NULL, OPT_RLIMIT},
+        {"sample-interval", required_argument, NULL, OPT_SAMPLE_INTERVAL},
+        {"sched",     required_argument, NULL, OPT_SCHED},
+        {"schedule",  required_argument, NULL, OPT_SCHEDULE},
+        {"seed",      required_argument, NULL, OPT_SEED},
+        {"store",     required_argument, NULL, OPT_STORE},
+        {"stream",    no_argument,       NULL, OPT_STREAM},
+        {"target-ci", required_argument, NULL, OPT_TARGET_CI},
+        {"threshold", required_argument, NULL, OPT_THRESHOLD},
+        {"time-budget", required_argument, NULL, OPT_TIME_BUDGET},
+        {"timeout",   required_argument, NULL, OPT_TIMEOUT},
+        {"wait",      required_argument, NULL, OPT_WAIT},
+        {NULL,        0,                 NULL, 0}
+    };
+    int ch, longi;
+    while ((ch = getopt_long(argc, argv, "+b:c:f:hi:j:ln:I:o:pqr:s:v",
+      longopts, &longi)) != -1) {
         switch (ch) {
             case 'b':
                 batch_file = optarg;
@@ -604,6 +1390,18 @@ int main(int argc, char** argv)
             case 'i':
                 input_cmd = optarg;
                 break;
+            case 'j': {
+                errno = 0;
+                char *ep = optarg + strlen(optarg);
+                long lval = strtoimax(optarg, &ep, 10);
+                if (optarg[0] == 0 || *ep != 0)
+                    usage(1, "'jobs' not a valid number.");
+                if ((errno == ERANGE && (lval == INTMAX_MIN || lval == INTMAX_MAX))
+                  || lval <= 0 || lval > INT_MAX)
+                    usage(1, "'jobs' out of range.");
+                conf->jobs = (int) lval;
+                break;
+            }
             case 'l':
                 conf->format_style = FORMAT_RUSAGE;
                 break;
@@ -614,7 +1412,7 @@ int main(int argc, char** argv)
                 if (optarg[0] == 0 || *ep != 0)
                     usage(1, "'num runs' not a valid number.");
                 if ((errno == ERANGE && (lval == INTMAX_MIN || lval == INTMAX_MAX))
-                  || lval <= 0 || lval >= UINT_MAX)
+                  || lval <= 0 || lval > INT_MAX)
                     usage(1, "'num runs' out of range.");
                 conf->num_runs = (int) lval;
                 break;
@@ -634,19 +1432,289 @@ int main(int argc, char** argv)
                 pre_cmd = optarg;
                 break;
             case 's': {
-                char *ep = optarg + strlen(optarg);
-                long lval = strtoimax(optarg, &ep, 10);
+                errno = 0;
+                char *ep;
+                double dval = strtod(optarg, &ep);
                 if (optarg[0] == '\0' || *ep != '\0')
                     usage(1, "'sleep' not a valid number.");
-                if ((errno == ERANGE && (lval == INTMAX_MIN || lval == INTMAX_MAX))
-                  || lval < 0)
+                if (errno == ERANGE || !(dval >= 0 && dval <= INT_MAX))
                     usage(1, "'sleep' out of range.");
-                conf->sleep = (int) lval;
+                conf->sleep = dval;
                 break;
             }
             case 'v':
                 conf->verbosity += 1;
                 break;
+            case OPT_BASELINE: {
+                errno = 0;
+                char *ep = optarg + strlen(optarg);
+                long lval = strtoimax(optarg, &ep, 10);
+                if (optarg[0] == 0 || *ep != 0)
+                    usage(1, "'baseline' not a valid number.");
+                if ((errno == ERANGE && (lval == INTMAX_MIN || lval == INTMAX_MAX))
+                  || lval <= 0 || lval > INT_MAX)
+                    usage(1, "'baseline' out of range.");
+                conf->baseline = (int) lval - 1;
+                break;
+            }
+            case OPT_BOOTSTRAP: {
+                errno = 0;
+                char *ep = optarg + strlen(optarg);
+                long lval = strtoimax(optarg, &ep, 10);
+                if (optarg[0] == 0 || *ep != 0)
+                    usage(1, "'resamples' not a valid number.");
+                if ((errno == ERANGE && (lval == INTMAX_MIN || lval == INTMAX_MAX))
+                  || lval <= 0 || lval > INT_MAX)
+                    usage(1, "'resamples' out of range.");
+                conf->bootstrap = (int) lval;
+                break;
+            }
+            case OPT_BOOTSTRAP_METHOD: {
+                int k;
+                for (k = 0; boot_method_names[k] != NULL; k += 1) {
+                    if (strcmp(optarg, boot_method_names[k]) == 0)
+                        break;
+                }
+                if (boot_method_names[k] == NULL)
+                    usage(1, "Unknown bootstrap method.");
+                conf->boot_method = (enum Boot_Method) k;
+                break;
+            }
+            case OPT_OUTLIERS: {
+                int k;
+                for (k = 0; outlier_method_names[k] != NULL; k += 1) {
+                    if (strcmp(optarg, outlier_method_names[k]) == 0)
+                        break;
+                }
+                if (outlier_method_names[k] == NULL)
+                    usage(1, "Unknown outlier method.");
+                conf->outliers = (enum Outlier_Method) k;
+                break;
+            }
+            case OPT_PARAM: {
+                const char *msg = sweep_parse(conf, optarg);
+                if (msg != NULL)
+                    usage(1, (char *) msg);
+                break;
+            }
+            case OPT_EXCLUDE_OUTLIERS:
+                conf->exclude_outliers = true;
+                break;
+            case OPT_CALIBRATE:
+                if (strcmp(optarg, "report") == 0)
+                    conf->calibrate = CALIBRATE_REPORT;
+                else if (strcmp(optarg, "subtract") == 0)
+                    conf->calibrate = CALIBRATE_SUBTRACT;
+                else
+                    usage(1, "Unknown calibration mode.");
+                break;
+            case OPT_CGROUP:
+                conf->cgroup = optarg;
+                break;
+            case OPT_COMPARE_TO:
+                conf->compare_to = optarg;
+                break;
+            case OPT_CPUS: case OPT_IOPRIO: case OPT_NICE: case OPT_NUMA_NODE:
+            case OPT_RLIMIT: case OPT_SCHED: case OPT_TIMEOUT: {
+                const char *msg = isolate_parse(&iso, longopts[longi].name,
+                  optarg);
+                if (msg != NULL)
+                    usage(1, (char *) msg);
+                break;
+            }
+            case OPT_ENGINE: {
+                int k;
+                for (k = 0; engine_names[k] != NULL; k += 1) {
+                    if (strcmp(optarg, engine_names[k]) == 0)
+                        break;
+                }
+                if (engine_names[k] == NULL)
+                    usage(1, "Unknown engine.");
+                conf->engine = (enum Engine) k;
+                engine_set = true;
+                break;
+            }
+            case OPT_EXPORT_CSV:
+                conf->export_csv = optarg;
+                break;
+            case OPT_EVICT:
+                evict_add(conf, optarg);
+                break;
+            case OPT_DIGEST:
+                conf->digest = true;
+                break;
+            case OPT_KEEP_GOING:
+                conf->keep_going = true;
+                break;
+            case OPT_INPUT_PIPE:
+#               ifndef MT_HAVE_PTHREADS
+                usage(1, "--input-pipe is not supported on this platform.");
+#               endif
+                conf->input_pipe = true;
+                break;
+            case OPT_EXPORT_JSON:
+                conf->export_json = optarg;
+                break;
+            case OPT_HISTOGRAM:
+                conf->histogram = true;
+                break;
+            case OPT_EXPORT_SAMPLES:
+                conf->export_samples = optarg;
+                break;
+            case OPT_LABEL:
+                conf->label = optarg;
+                label_set = true;
+                break;
+            case OPT_MAX_RUNS: {
+                errno = 0;
+                char *ep = optarg + strlen(optarg);
+                long lval = strtoimax(optarg, &ep, 10);
+                if (optarg[0] == 0 || *ep != 0)
+                    usage(1, "'max runs' not a valid number.");
+                if ((errno == ERANGE && (lval == INTMAX_MIN || lval == INTMAX_MAX))
+                  || lval <= 0 || lval > INT_MAX)
+                    usage(1, "'max runs' out of range.");
+                conf->max_runs = (int) lval;
+                conf->adaptive = true;
+                break;
+            }
+            case OPT_PERCENTILES: {
+                // A comma separated list of percentiles, e.g. "90,99,99.9".
+                conf->num_percentiles = 0;
+                char *p = optarg;
+                while (true) {
+                    errno = 0;
+                    char *ep;
+                    double dval = strtod(p, &ep);
+                    if (ep == p || (*ep != ',' && *ep != '\0'))
+                        usage(1, "'percentiles' not a valid list of numbers.");
+                    if (errno == ERANGE || dval <= 0 || dval >= 100)
+                        usage(1, "'percentiles' out of range.");
+                    conf->percentiles = realloc(conf->percentiles,
+                      (conf->num_percentiles + 1) * sizeof(double));
+                    if (conf->percentiles == NULL)
+                        errx(1, "Out of memory.");
+                    conf->percentiles[conf->num_percentiles++] = dval / 100;
+                    if (*ep == '\0')
+                        break;
+                    p = ep + 1;
+                }
+                break;
+            }
+            case OPT_PERF:
+                conf->perf = true;
+                break;
+            case OPT_SAMPLE_INTERVAL: {
+#               ifndef MT_HAVE_PIDFD
+                usage(1, "--sample-interval is not supported on this platform.");
+#               endif
+                errno = 0;
+                char *ep;
+                double dval = strtod(optarg, &ep);
+                if (optarg[0] == '\0' || *ep != '\0')
+                    usage(1, "'sample interval' not a valid number.");
+                if (errno == ERANGE || dval < 0.001)
+                    usage(1, "'sample interval' out of range.");
+                conf->sample_interval = dval;
+                break;
+            }
+            case OPT_NOISE:
+                conf->noise = true;
+                break;
+            case OPT_NOISE_THRESHOLD: {
+                errno = 0;
+                char *ep;
+                double dval = strtod(optarg, &ep);
+                if (optarg[0] == '\0' || *ep != '\0')
+                    usage(1, "'noise threshold' not a valid number.");
+                if (errno == ERANGE || !(dval >= 0 && dval <= 100))
+                    usage(1, "'noise threshold' out of range.");
+                conf->noise_threshold = dval;
+                conf->noise = true;
+                break;
+            }
+            case OPT_RANDOMIZE_LAYOUT:
+                conf->randomize_layout = true;
+                break;
+            case OPT_RANDOMIZE_PWD:
+                conf->randomize_pwd = true;
+                break;
+            case OPT_WAIT: {
+                int k;
+                for (k = 0; wait_names[k] != NULL; k += 1) {
+                    if (strcmp(optarg, wait_names[k]) == 0)
+                        break;
+                }
+                if (wait_names[k] == NULL)
+                    usage(1, "Unknown wait policy.");
+                conf->wait = (enum Wait) k;
+                break;
+            }
+            case OPT_SCHEDULE: {
+                int k;
+                for (k = 0; schedule_names[k] != NULL; k += 1) {
+                    if (strcmp(optarg, schedule_names[k]) == 0)
+                        break;
+                }
+                if (schedule_names[k] == NULL)
+                    usage(1, "Unknown schedule.");
+                conf->schedule = (enum Schedule) k;
+                break;
+            }
+            case OPT_SEED: {
+                errno = 0;
+                char *ep;
+                uintmax_t uval = strtoumax(optarg, &ep, 10);
+                if (optarg[0] == '\0' || optarg[0] == '-' || *ep != '\0')
+                    usage(1, "'seed' not a valid number.");
+                if (errno == ERANGE || uval > UINT64_MAX)
+                    usage(1, "'seed' out of range.");
+                conf->seed = (uint64_t) uval;
+                conf->has_seed = true;
+                break;
+            }
+            case OPT_STORE:
+                conf->store = optarg;
+                break;
+            case OPT_STREAM:
+                conf->stream = true;
+                break;
+            case OPT_THRESHOLD: {
+                errno = 0;
+                char *ep;
+                double dval = strtod(optarg, &ep);
+                if (optarg[0] == '\0' || *ep != '\0')
+                    usage(1, "'threshold' not a valid number.");
+                if (errno == ERANGE || dval < 0)
+                    usage(1, "'threshold' out of range.");
+                conf->threshold = dval;
+                threshold_set = true;
+                break;
+            }
+            case OPT_TARGET_CI: {
+                errno = 0;
+                char *ep;
+                double dval = strtod(optarg, &ep);
+                if (optarg[0] == '\0' || *ep != '\0')
+                    usage(1, "'target CI' not a valid number.");
+                if (errno == ERANGE || dval <= 0 || dval >= 100)
+                    usage(1, "'target CI' out of range.");
+                conf->target_ci = dval;
+                conf->adaptive = true;
+                break;
+            }
+            case OPT_TIME_BUDGET: {
+                errno = 0;
+                char *ep;
+                double dval = strtod(optarg, &ep);
+                if (optarg[0] == '\0' || *ep != '\0')
+                    usage(1, "'time budget' not a valid number.");
+                if (errno == ERANGE || dval <= 0)
+                    usage(1, "'time budget' out of range.");
+                conf->time_budget = dval;
+                conf->adaptive = true;
+                break;
+            }
             default:
                 usage(1, NULL);
                 break;
@@ -657,10 +1725,66 @@ int main(int argc, char** argv)
 
     if (batch_file && conf->format_style == FORMAT_LIKE_TIME)
         usage(1, "Can't use batch file mode with -f liketime.");
+    if (conf->num_params > 0 && conf->format_style == FORMAT_LIKE_TIME)
+        usage(1, "Can't use --param with -f liketime.");
     if (batch_file && (input_cmd || output_cmd || replace_str || quiet_stdout))
         usage(1, "In batch file mode, -I/-i/-o/-q must be specified per-command in the batch file.");
+    if (batch_file && (isolate_any(&iso) || iso.timeout > 0))
+        usage(1, "In batch file mode, --cpus/--ioprio/--nice/--numa-node/--rlimit/--sched/--timeout must be specified per-command in the batch file.");
     if (quiet_stdout && output_cmd)
         usage(1, "-q and -o are mutually exclusive.");
+    if (conf->num_runs > conf->max_runs)
+        usage(1, "'num runs' can't be more than 'max runs'.");
+    if (conf->bootstrap > 0 && conf->stream)
+        usage(1, "--bootstrap and --stream are mutually exclusive.");
+    if (conf->baseline >= 0 && !batch_file)
+        usage(1, "--baseline can only be used in batch file mode.");
+    if (conf->baseline >= 0 && conf->stream)
+        usage(1, "--baseline and --stream are mutually exclusive.");
+    if (conf->num_evict_files > 0 && conf->stream)
+        usage(1, "--evict and --stream are mutually exclusive.");
+    if ((conf->compare_to || label_set) && !conf->store)
+        usage(1, "--compare-to and --label require --store.");
+    if (threshold_set && !conf->compare_to)
+        usage(1, "--threshold requires --compare-to.");
+    // Excluding outliers means detecting them, by default with Tukey's fences.
+    if (conf->exclude_outliers && conf->outliers == OUTLIERS_NONE)
+        conf->outliers = OUTLIERS_TUKEY;
+    if (conf->outliers != OUTLIERS_NONE && conf->stream)
+        usage(1, "--outliers and --stream are mutually exclusive.");
+    // Cold and warm runs are expected to differ, so one set would be flagged
+    // as outliers of the other.
+    if (conf->outliers != OUTLIERS_NONE && conf->num_evict_files > 0)
+        usage(1, "--outliers and --evict are mutually exclusive.");
+    if (conf->export_samples && conf->sample_interval == 0)
+        usage(1, "--export-samples requires --sample-interval.");
+    if (conf->store && conf->stream)
+        usage(1, "--store and --stream are mutually exclusive.");
+    if ((conf->randomize_layout || conf->randomize_pwd) && conf->stream)
+        usage(1, "--randomize-layout/--randomize-pwd and --stream are mutually exclusive.");
+    // posix_spawn gives us no way of changing the child's personality.
+    if (conf->randomize_layout && conf->engine == ENGINE_SPAWN)
+        usage(1, "--randomize-layout can't be used with --engine spawn.");
+    // Concurrent runs would count as each other's noise.
+    if (conf->noise && conf->jobs > 1)
+        usage(1, "--noise can't be used with -j.");
+    if (conf->num_evict_files > 0 && conf->num_runs < 2)
+        usage(1, "--evict requires at least 2 runs of each command.");
+    // Performance counters and cgroups must be attached to a child before it
+    // execs, so the child has to wait for us.
+    if (conf->perf && engine_set && conf->engine != ENGINE_PREFORK)
+        usage(1, "--perf can only be used with --engine prefork.");
+    if (conf->cgroup && engine_set && conf->engine != ENGINE_PREFORK)
+        usage(1, "--cgroup can only be used with --engine prefork.");
+    if (conf->perf || conf->cgroup)
+        conf->engine = ENGINE_PREFORK;
+
+    // When running in parallel, a short serial control sample of each command
+    // is taken to check whether parallelism has distorted the timings.
+    if (!conf->adaptive && conf->num_runs < CONTROL_RUNS)
+        conf->num_ctrl_runs = conf->num_runs;
+    else
+        conf->num_ctrl_runs = CONTROL_RUNS;
 
     if (conf->format_style == FORMAT_UNKNOWN) {
         if (strcmp(__progname, "time") == 0)
@@ -689,74 +1813,110 @@ int main(int argc, char** argv)
         conf->num_cmds = 1;
         conf->cmds[0] = cmd;
         cmd->argv = argv;
+        cmd->path = NULL;
         cmd->pre_cmd = pre_cmd;
         cmd->input_cmd = input_cmd;
         cmd->output_cmd = output_cmd;
         cmd->replace_str = replace_str;
         cmd->quiet_stdout = quiet_stdout;
         cmd->quiet_stderr = quiet_stderr;
-        cmd->rusages = malloc(sizeof(struct rusage *) * conf->num_runs);
-        cmd->timevals = malloc(sizeof(struct timeval *) * conf->num_runs);
-        memset(cmd->rusages, 0, sizeof(struct rusage *) * conf->num_runs);
-        memset(cmd->timevals, 0, sizeof(struct rusage *) * conf->num_runs);
+        cmd->iso = iso;
+        cmd->param_vals = NULL;
     }
 
-    // Seed the random number generator.
+    sweep_expand(conf);
+    if (conf->baseline >= conf->num_cmds)
+        usage(1, "'baseline' out of range.");
+    for (int i = 0; i < conf->num_cmds; i += 1)
+        init_runs(conf, conf->cmds[i]);
 
-#   if defined(MT_HAVE_ARC4RANDOM)
-    // arc4random doesn't need to be seeded
-#	elif defined(MT_HAVE_DRAND48)
-	struct timeval tv;
-
-	gettimeofday(&tv, NULL);
-	srand48(tv.tv_sec ^ tv.tv_usec);
-#	elif defined(MT_HAVE_RANDOM) && defined(MT_HAVE_SRANDOMDEV)
-	srandomdev();
-#	elif defined(MT_HAVE_RANDOM)
-	struct timeval tv;
-
-	gettimeofday(&tv, NULL);
-	srandom(tv.tv_sec ^ tv.tv_usec);
-#	else
-	struct timeval tv;
+    // posix_spawn gives us no way of applying isolation settings in the child.
+    for (int i = 0; i < conf->num_cmds; i += 1) {
+        if (conf->engine == ENGINE_SPAWN && isolate_any(&conf->cmds[i]->iso))
+            usage(1, "--cpus/--ioprio/--nice/--numa-node/--rlimit/--sched can't be used with --engine spawn.");
+    }
 
-	gettimeofday(&tv, NULL);
-	srand(tv.tv_sec ^ tv.tv_usec);
-#	endif
+    schedule_init(conf);
+    sysmon_init(conf);
+    if (conf->randomize_layout || conf->randomize_pwd) {
+        conf->num_layouts = NUM_LAYOUTS;
+        layout_init(conf);
+    }
 
-    for (int i = 0; i < (conf->num_cmds * conf->num_runs); i += 1) {
-        // Find a command which has not yet had all its runs executed.
-        Cmd *cmd;
-        while (true) {
-            cmd = conf->cmds[RANDN(conf->num_cmds)];
-            int j;
-            for (j = 0; j < conf->num_runs; j += 1) {
-                if (cmd->rusages[j] == NULL)
-                    break;
-            }
-            if (j < conf->num_runs)
-                break;
+    if (conf->perf)
+        perf_probe(conf);
+    if (conf->cgroup)
+        cgroup_probe(conf);
+    if (conf->sample_interval > 0)
+        sample_probe(conf);
+    if (conf->noise)
+        sysmon_noise_probe(conf);
+    // Calibration runs are pinned to worker 0's CPUs when -j is used, so the
+    // workers must be set up first.
+    if (conf->jobs > 1)
+        init_workers(conf);
+    if (conf->calibrate != CALIBRATE_NONE)
+        calibrate(conf);
+    for (int i = 0; i < conf->num_cmds; i += 1) {
+        if (conf->cmds[i]->iso.timeout > 0) {
+            timeout_init(conf);
+            break;
         }
+    }
 
-        // Find a run of cmd which has not yet been executed.
+    clock_gettime(MT_CLOCK, &conf->start_time);
+    if (conf->jobs > 1)
+        execute_parallel(conf);
+    else {
+        Cmd *cmd;
         int runi;
-        while (true) {
-            runi = RANDN(conf->num_runs);
-            if (cmd->rusages[runi] == NULL)
-                break;
+        bool first = true;
+        while (next_run(conf, &cmd, &runi)) {
+            // Sleep between runs (though not before the first).
+            if (!first)
+                sysmon_pause(conf);
+            first = false;
+            execute_cmd(conf, cmd, runi, false, -1);
         }
+    }
 
-        // Execute the command and, if there are more commands yet to be run,
-        // sleep.
-        execute_cmd(conf, cmd, runi);
-        if (i + 1 < conf->num_runs && conf->sleep > 0)
-	        usleep(RANDN(conf->sleep * 1000000));
+    if (conf->outliers != OUTLIERS_NONE) {
+        for (int i = 0; i < conf->num_cmds; i += 1)
+            outliers_flag(conf, conf->cmds[i]);
     }
+    if (conf->num_params > 0)
+        sweep_fit(conf);
+
+    // Compare with the stored results before adding to them, so that new
+    // results can be compared with the previous ones under the same label.
+    if (conf->compare_to)
+        store_load(conf);
+    if (conf->store)
+        store_append(conf);
 
     if (conf->format_style == FORMAT_LIKE_TIME)
         format_like_time(conf);
     else
         format_other(conf);
 
+    if (conf->export_json)
+        export_json(conf, conf->export_json);
+    if (conf->export_csv)
+        export_csv(conf, conf->export_csv);
+    sample_close(conf);
+
+    int status = 0;
+    for (int i = 0; i < conf->num_cmds; i += 1) {
+        Cmd *cmd = conf->cmds[i];
+        if (store_regression(conf, cmd))
+            status = EXIT_REGRESSION;
+        // A command with no successful runs has no results at all.
+        else if (cmd->num_done == 0
+          && cmd->num_failed + cmd->num_timed_out > 0 && status == 0)
+            status = 1;
+    }
+
     free(conf);
+
+    return status;
 }
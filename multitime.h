@@ -21,27 +21,414 @@
 
 enum Format_Style {FORMAT_UNKNOWN, FORMAT_LIKE_TIME, FORMAT_NORMAL, FORMAT_RUSAGE};
 
+// How runs are launched. Must be kept in sync with engine_names.
+enum Engine {ENGINE_FORK, ENGINE_VFORK, ENGINE_SPAWN, ENGINE_PREFORK};
+extern const char *engine_names[];
+
+enum Calibrate {CALIBRATE_NONE, CALIBRATE_REPORT, CALIBRATE_SUBTRACT};
+
+// How bootstrap confidence intervals are derived. Must be kept in sync with
+// boot_method_names.
+enum Boot_Method {BOOT_PERCENTILE, BOOT_BCA};
+extern const char *boot_method_names[];
+
+// How outlying runs are detected (see outlier.c). Must be kept in sync with
+// outlier_method_names.
+enum Outlier_Method {OUTLIERS_NONE, OUTLIERS_TUKEY, OUTLIERS_MAD};
+extern const char *outlier_method_names[];
+
+// The order in which runs are executed (see schedule.c). Must be kept in sync
+// with schedule_names.
+enum Schedule {SCHEDULE_RANDOM, SCHEDULE_INTERLEAVE, SCHEDULE_BLOCK,
+  SCHEDULE_ABBA};
+extern const char *schedule_names[];
+
+// How to wait between runs (see sysmon.c). Must be kept in sync with
+// wait_names.
+enum Wait {WAIT_RANDOM, WAIT_QUIESCE};
+extern const char *wait_names[];
+
+// How a run ended. Failed runs (those which exited with a non-zero status or
+// were killed by a signal) only get this far with --keep-going. Must be kept in
+// sync with state_names.
+enum Run_State {STATE_OK, STATE_FAILED, STATE_TIMED_OUT};
+extern const char *state_names[];
+
+// The per-run measurements: times, then rusage fields, then performance
+// counters (see perf.c), then cgroup accounting (see cgroup.c), then sampled
+// resource usage (see sample.c), then system noise (see sysmon.c), then page
+// cache residency (see evict.c), then memory layout (see layout.c). Must be
+// kept in sync with metric_names and metric_scales.
+enum Metric {METRIC_REAL, METRIC_USER, METRIC_SYS, METRIC_MAXRSS,
+  METRIC_MINFLT, METRIC_MAJFLT, METRIC_NSWAP, METRIC_INBLOCK, METRIC_OUBLOCK,
+  METRIC_MSGSND, METRIC_MSGRCV, METRIC_NSIGNALS, METRIC_NVCSW, METRIC_NIVCSW,
+  METRIC_CYCLES, METRIC_INSTRS, METRIC_IPC, METRIC_CACHE_MISSES,
+  METRIC_BRANCH_MISSES, METRIC_TASK_CLOCK, METRIC_CTX_SWITCHES,
+  METRIC_PAGE_FAULTS, METRIC_CG_CPU, METRIC_CG_MEM, METRIC_CG_RBYTES,
+  METRIC_CG_WBYTES, METRIC_CG_PIDS, METRIC_RSS_PEAK, METRIC_RSS_MEAN,
+  METRIC_CPU_MEAN, METRIC_CPU_PEAK, METRIC_THREADS, METRIC_NOISE,
+  METRIC_OTHER_CPU, METRIC_INTERRUPTS, METRIC_PAGING, METRIC_PSI_CPU,
+  METRIC_PSI_MEM, METRIC_PSI_IO, METRIC_CPU_MHZ, METRIC_CACHE_PRE,
+  METRIC_CACHE_POST, METRIC_LAYOUT, METRIC_ENV_PAD, METRIC_ASLR,
+  METRIC_PWD_PAD, NUM_METRICS};
+extern const char *metric_names[];
+// What each metric's recorded (integer) values must be multiplied by to get
+// the values reported.
+extern const double metric_scales[];
+// True if metric m is a time (recorded in ns, and reported in seconds).
+#define METRIC_IS_TIME(m) ((m) <= METRIC_SYS)
+#define FIRST_PERF_METRIC METRIC_CYCLES
+#define FIRST_CGROUP_METRIC METRIC_CG_CPU
+#define FIRST_SAMPLE_METRIC METRIC_RSS_PEAK
+#define FIRST_NOISE_METRIC METRIC_NOISE
+#define FIRST_CACHE_METRIC METRIC_CACHE_PRE
+#define FIRST_LAYOUT_METRIC METRIC_LAYOUT
+// True if metric m needs hardware performance counters.
+#define METRIC_IS_HW(m) ((m) >= METRIC_CYCLES && (m) <= METRIC_BRANCH_MISSES)
+// How many perf events are opened for each run.
+#define NUM_PERF_EVENTS 7
+
+// The clock runs are timed with. It must be monotonic so that changes to the
+// system time don't distort timings; where available, we use the "raw" clock
+// which isn't slewed by NTP either.
+#ifdef CLOCK_MONOTONIC_RAW
+#define MT_CLOCK CLOCK_MONOTONIC_RAW
+#else
+#define MT_CLOCK CLOCK_MONOTONIC
+#endif
+
+// True if run i of cmd succeeded. A command without per-run states (e.g. one
+// built from stored results) only has successful runs.
+#define RUN_IS_OK(cmd, i) ((cmd)->states == NULL \
+  || (cmd)->states[(i)] == STATE_OK)
+
+// Summary statistics of one metric over a command's runs. Times are in
+// seconds.
+
+typedef struct {
+    double mean, ci, stddev, min, median, max;
+} Summary;
+
+// How much of the variance of a command's real times is due to the memory
+// layout runs executed in (see layout.c). Statistics which couldn't be
+// estimated are NAN.
+
+typedef struct {
+    int num_layouts;           // How many layouts the runs executed in.
+    double share;              // Fraction of the variance between layouts.
+    double between_sd, within_sd; // Standard deviations between and within
+                               // layouts, in seconds.
+    double p;                  // p-value of the layouts' means being equal.
+} Layout_Anova;
+
+// A histogram of a command's real times (see histogram.c). Edges are in
+// seconds.
+
+#define MAX_HISTOGRAM_BINS 40
+
+typedef struct {
+    int num_bins;
+    bool log;                  // True = bins have equal widths in log(time).
+    double edges[MAX_HISTOGRAM_BINS + 1];
+    uint64_t counts[MAX_HISTOGRAM_BINS];
+} Histogram;
+
+// Kaplan-Meier estimates of a command's real times, allowing for timed out
+// runs (see timeout.c). Times are in seconds.
+
+typedef struct {
+    double median;             // NAN = at least half the runs timed out.
+    double rmean;              // The mean restricted to [0, limit].
+    double limit;
+} Survival;
+
+// Robust estimators of one metric over a command's runs (see outlier.c), in
+// the same units as Summary.
+
+typedef struct {
+    double trimmed_mean, mad, iqr;
+} Robust;
+
+// Constant-memory statistics of one metric, updated as each run finishes
+// (see stream.c). Values are in ns for times, and as reported by getrusage
+// otherwise.
+
+typedef struct {
+    uint64_t n;
+    double mean, m2;           // Running mean and sum of squared differences.
+    uint64_t min, max;
+    uint32_t *counts;          // How many values fell into each bucket of a
+                               // log-linear histogram (NULL until the first
+                               // value is added).
+} Stream;
+
+// How a command compares with the baseline command (see compare.c).
+
+enum Verdict {VERDICT_INDISTINGUISHABLE, VERDICT_FASTER, VERDICT_SLOWER};
+extern const char *verdict_names[];
+
+typedef struct {
+    double speedup;            // Baseline's mean real time / this command's.
+    double speedup_lo, speedup_hi; // CI of speedup.
+    double welch_p;            // p-value of Welch's t-test.
+    double mw_p;               // p-value of the Mann-Whitney U test.
+    double mw_a;               // Probability that a run of this command is
+                               // faster than one of the baseline.
+    enum Verdict verdict;
+} Comparison;
+
+// A command's runs as previously recorded in a results store (see store.c).
+
+typedef struct {
+    time_t when;               // When the runs were stored.
+    int64_t *reals;            // Each run's real time in ns.
+    int num_runs;
+    Comparison cmp;            // How the command's new runs compare with
+                               // these.
+} Stored;
+
+// How a command's runs are isolated from the rest of the system, and what
+// limits they run under (see isolate.c). All zeros = inherit everything from
+// multitime, with no limits.
+
+#define MAX_RLIMITS 8
+
+typedef struct {
+    const char *cpu_list;      // The CPUs to pin runs to, as given by the
+    int *cpus;                 // user, and parsed. NULL = inherit.
+    int num_cpus;
+    bool has_sched;            // True = set the scheduling policy and its
+    int sched_policy;          // (static) priority.
+    int sched_prio;
+    bool has_nice;
+    int nice;
+    int ioprio_class;          // 0 = inherit.
+    int ioprio_level;
+    bool has_numa_node;        // True = bind memory to numa_node.
+    int numa_node;
+    int num_rlimits;           // Resource limits (see setrlimit), each
+    int rlimit_res[MAX_RLIMITS]; // setting both the soft and hard limits.
+    rlim_t rlimit_vals[MAX_RLIMITS];
+    double timeout;            // Seconds after which a run is killed (see
+                               // timeout.c). 0 = no timeout.
+} Isolation;
+
 typedef struct {
     char ** argv;
+    char *path;                // The executable argv[0] resolves to.
     const char *pre_cmd;
     const char *input_cmd;
     const char *output_cmd;
     const char *replace_str;
     bool quiet_stdout;         // True = suppress command's stdout.
     bool quiet_stderr;         // True = suppress command's stderr.
-    struct timeval **timevals; // The wall clock time for each command run.
-    struct rusage **rusages;   // The rusage each command run.
+    Isolation iso;
+    int64_t *samples[NUM_METRICS]; // One column per metric, holding each
+                               // run's value (times in ns).
+    int64_t *ctrl_reals;       // The wall clock time, in ns, of each run of
+                               // the serial control sample (-j only).
+    int *orders;               // The position (from 0) in which each run was
+                               // started, across all commands. -1 = not yet
+                               // started.
+    Stream *streams;           // One per metric (streaming mode only, when
+                               // samples/orders are not kept).
+    int num_runs;              // How many runs samples hold.
+    int runs_cap;              // How many runs samples have room for.
+    int num_started;           // How many runs have been started.
+    int num_done;              // How many runs have finished.
+    double real_mean, real_m2; // Running mean and sum of squared differences
+                               // of finished runs' real times (in seconds).
+    bool converged;            // True = CI narrow enough (adaptive mode).
+    uint64_t *digests;         // Each run's output digest (--digest only).
+    uint64_t digest;           // The first finished run's output digest.
+    int num_digested;          // How many runs' output has been digested,
+    int num_digest_diffs;      // and how many differed from digest.
+    bool *outliers;            // Whether each run is an outlier (--outliers
+                               // only). NULL = not yet flagged.
+    int num_outliers;
+    enum Run_State *states;    // How each run ended. Only successful runs
+                               // are included in statistics.
+    int num_failed;            // How many runs failed,
+    int num_timed_out;         // and how many timed out.
+    int num_noisy;             // How many successful runs had a noise score
+    double noisy_real;         // above conf->noise_threshold, and their
+                               // total real time in seconds (--noise only).
+    Stored *stored;            // The runs compared against (--compare-to
+                               // only). NULL = none found.
+    int *param_vals;           // The value (index) of each parameter the
+                               // command was expanded with (see sweep.c). -1
+                               // = parameter not used. NULL = not a sweep.
+    int origin;                // The command (from 0) as given by the user
+                               // which this command was expanded from.
+    double *boot_ests, *boot_los, *boot_his; // Bootstrapped statistics of
+                               // the real times and their CIs (see
+                               // bootstrap.c). NULL = not yet bootstrapped.
 } Cmd;
 
+// One observation of a run's process tree (see sample.c).
+
+typedef struct {
+    int64_t t;                 // ns since the run started.
+    int64_t rss;               // Total resident set size in KiB.
+    int64_t cpu;               // Total CPU time used so far in ns.
+    int threads;               // Total number of threads.
+} Sample;
+
+// A memory layout runs can execute in (see layout.c).
+
+typedef struct {
+    int env_pad;               // Bytes of environment padding. -1 = none.
+    bool no_aslr;              // True = ASLR turned off.
+    int pwd_pad;               // Characters added to PWD, and its padded
+    char *pwd;                 // value. NULL = unchanged.
+    char **envp;               // The environment runs are executed with.
+} Layout;
+
+// A run of a command which has been started but not yet reaped.
+
+typedef struct {
+    Cmd *cmd;
+    int runi;
+    bool control;              // True = part of the serial control sample.
+    pid_t pid;                 // 0 = not currently running.
+    int in_fd;                 // The run's stdin. -1 = inherit.
+    void *feeder;              // Thread feeding in_fd (see input.c). NULL =
+                               // none.
+    int out_fd;                // Captured stdout (see output.c). -1 = not
+                               // captured.
+    char *output_cmd;
+    struct timespec startt;
+    int perf_fds[NUM_PERF_EVENTS]; // -1 = not open.
+    char *cgroup;              // The run's own cgroup directory. NULL = none.
+    int64_t cache_pre;         // Page cache residency before the run (see
+                               // evict.c).
+    int pidfd;                 // -1 = not sampling (see sample.c).
+    int64_t next_sample;       // When (in ns of MT_CLOCK) the next sample is
+                               // due.
+    Sample *samples;
+    int num_samples, samples_cap;
+    int64_t deadline;          // When (in ns of MT_CLOCK) the run is next
+                               // signalled (see timeout.c).
+    volatile int timeout_stage; // 0 = not timed out; 1 = sent SIGTERM; 2 =
+                               // sent SIGKILL.
+    int layout;                // Index into conf->layouts. -1 = default.
+} Run;
+
+// A parameter which commands are swept over (see sweep.c).
+
+typedef struct {
+    const char *name;          // Substituted wherever {name} appears.
+    char **vals;               // The values, as substituted.
+    double *nums;              // Each value as a number. NAN = not numeric.
+    int num_vals;
+} Param;
+
+// How a command's real times scale with one parameter while the others are
+// held fixed (see sweep.c). Fits which couldn't be made are NAN.
+
+typedef struct {
+    int param;                 // Index into conf->params.
+    Cmd **cmds;                // One per value of the parameter, in order.
+    double *means;             // Each command's mean real time in seconds.
+    bool parallel;             // True = times fall as the parameter grows,
+                               // so it is treated as a degree of parallelism.
+    double exponent, exponent_r2; // Power law: time ~ value^exponent.
+    double serial, amdahl_r2;  // Amdahl's law fit of the speedups (parallel
+                               // only).
+    double linear_r2;          // Fit of the speedups to linear scaling
+                               // (parallel only).
+} Sweep;
+
 typedef struct {
     Cmd **cmds;
     int num_cmds;               // How many commands the user has specified.
-    int num_runs;               // How many times to run each command.
+    int num_runs;               // How many times to run each command (in
+                                // adaptive mode, the minimum).
+    bool adaptive;              // True = the number of runs is decided as
+                                // they're executed.
+    double target_ci;           // Stop running a command once its CI is
+                                // within this percentage of its mean. 0 = off.
+    int max_runs;               // Max runs of each command in adaptive mode.
+    double time_budget;         // Stop starting runs after this many seconds.
+                                // 0 = no budget.
+    bool stream;                // True = keep constant-memory statistics
+                                // rather than every run's results.
+    Param *params;              // Parameters to sweep commands over.
+    int num_params;
+    Sweep *sweeps;              // Fits of every sweep (see sweep.c).
+    int num_sweeps;
+    struct timespec start_time; // When the first run was started.
+    int num_started;            // How many (non-control) runs of all
+                                // commands have been started.
+    enum Schedule schedule;
+    bool has_seed;              // True = seed was given by --seed.
+    uint64_t seed;              // Seed of the random number generator.
+    uint64_t rng;               // The random number generator's state.
+    int *sched;                 // The command (index) of each run, in the
+                                // order they're executed. NULL = each run's
+                                // command is picked as it's started.
+    int sched_pos;              // How many runs have been scheduled.
+    int sched_last;             // The command most recently picked (-1 =
+    int sched_dir;              // none) and, for abba, the sweep direction.
+    int jobs;                   // How many runs to execute in parallel.
+    int num_ctrl_runs;          // How many serial control runs to execute
+                                // for each command when jobs > 1.
     int conf_level;             // Confidence level (as a percentage, e.g. 95).
+    int bootstrap;              // How many bootstrap resamples to take. 0 =
+                                // no bootstrap CIs.
+    int baseline;               // The command (from 0) others are compared
+                                // against. -1 = no comparison.
+    enum Boot_Method boot_method;
+    enum Outlier_Method outliers;
+    bool histogram;             // True = show histograms of real times.
+    bool exclude_outliers;      // True = leave outliers out of the summary
+                                // statistics.
+    double *percentiles;        // Quantiles (between 0 and 1) to bootstrap
+    int num_percentiles;        // in addition to the mean and median.
 
     enum Format_Style format_style;
-    int sleep;                  // Time to sleep between commands, in seconds.
-                                // 0 = no sleep.
+    enum Engine engine;
+    enum Calibrate calibrate;
+    bool perf;                  // True = record performance counters.
+    bool perf_hw;               // True = hardware counters are available.
+    const char *cgroup;         // cgroup v2 directory under which each run
+                                // gets its own cgroup. NULL = off.
+    uint64_t overhead;          // Median time, in ns, to launch a no-op
+                                // command (only set if calibrate is enabled).
+    int num_below_overhead;     // How many runs took less than overhead.
+    double sleep;               // Max time to wait between commands, in
+                                // seconds. 0 = no wait.
+    enum Wait wait;
+    int num_waits;              // How many waits for quiescence there have
+    int num_capped_waits;       // been, and how many gave up after sleep
+    double waited;              // seconds; and their total length.
+    const char *export_json;    // File to export results to as JSON ("-" =
+                                // stdout). NULL = no export.
+    const char *export_csv;     // As export_json, but as CSV.
+    bool input_pipe;            // True = deliver -i input through a pipe.
+    bool digest;                // True = digest each run's stdout.
+    bool keep_going;            // True = record failed runs rather than
+                                // exiting.
+    bool noise;                 // True = record system noise during runs.
+    double noise_threshold;     // Noise score (as a percentage) above which
+                                // a run is noisy.
+    bool randomize_layout;      // True = vary environment size and ASLR.
+    bool randomize_pwd;         // True = vary the length of PWD.
+    Layout *layouts;            // The layouts runs are executed in (see
+    int num_layouts;            // layout.c). 0 = layout isn't randomised.
+    double sample_interval;     // Seconds between samples of each run's
+                                // processes. 0 = no sampling.
+    const char *export_samples; // File to export each run's samples to as CSV.
+                                // NULL = no export.
+    const char *store;          // Results store file. NULL = none.
+    const char *label;          // Label to store results under.
+    const char *compare_to;     // Label of stored results to compare against.
+                                // NULL = no comparison.
+    double threshold;           // Percentage slowdown against the stored
+                                // results beyond which a significant
+                                // slowdown is a regression.
+    char **evict_files;         // Files to evict from the page cache before
+    int num_evict_files;        // cold runs. 0 = no cold/warm runs.
     int verbosity;              // 0 to +ve: higher values may increase
                                 // verbosity.
 } Conf;
@@ -0,0 +1,202 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Outliers and robust estimators.
+//
+// A command's runs are flagged as outliers by their real times, either with
+// Tukey's fences (outside 1.5 interquartile ranges of the quartiles) or with
+// the median absolute deviation (a modified z-score above 3.5; Iglewicz and
+// Hoaglin 1993). Flagged runs are always reported; with
+// conf->exclude_outliers, they are also left out of the summary statistics,
+// bootstrap and comparisons. Runs which failed or timed out are never
+// flagged, being left out of the statistics anyway.
+//
+
+#include "Config.h"
+
+#include <err.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "multitime.h"
+#include "outlier.h"
+#include "stats.h"
+
+
+
+#define TUKEY_K 1.5
+#define MAD_Z 3.5
+// The modified z-score of x is MAD_SCALE * (x - median) / MAD.
+#define MAD_SCALE 0.6745
+// How much of each end of the sorted values the trimmed mean drops.
+#define TRIM 0.1
+
+const char *outlier_method_names[] = {"none", "tukey", "mad", NULL};
+
+int64_t *sorted_vals(Cmd *, enum Metric, int *);
+double mad(const int64_t *, int, double);
+
+
+
+
+//
+// Flag cmd's outlying runs, by their real times, using conf->outliers.
+//
+
+void outliers_flag(Conf *conf, Cmd *cmd)
+{
+    cmd->outliers = calloc(cmd->num_runs > 0 ? cmd->num_runs : 1, sizeof(bool));
+    if (cmd->outliers == NULL)
+        errx(1, "Out of memory.");
+    cmd->num_outliers = 0;
+
+    int n;
+    int64_t *xs = sorted_vals(cmd, METRIC_REAL, &n);
+    if (n < 3) {
+        free(xs);
+        return;
+    }
+    double lo, hi;
+    if (conf->outliers == OUTLIERS_TUKEY) {
+        double q1 = stats_quantile(xs, n, 0.25);
+        double q3 = stats_quantile(xs, n, 0.75);
+        lo = q1 - TUKEY_K * (q3 - q1);
+        hi = q3 + TUKEY_K * (q3 - q1);
+    }
+    else {
+        double med = stats_quantile(xs, n, 0.5);
+        double d = mad(xs, n, med);
+        // If most runs took exactly the same time, there's no spread to judge
+        // the others against.
+        if (d == 0) {
+            free(xs);
+            return;
+        }
+        lo = med - MAD_Z * d / MAD_SCALE;
+        hi = med + MAD_Z * d / MAD_SCALE;
+    }
+    free(xs);
+
+    for (int i = 0; i < cmd->num_runs; i += 1) {
+        int64_t x = cmd->samples[METRIC_REAL][i];
+        if (RUN_IS_OK(cmd, i) && (x < lo || x > hi)) {
+            cmd->outliers[i] = true;
+            cmd->num_outliers += 1;
+        }
+    }
+}
+
+
+
+//
+// Copy cmd's values of metric m into vals (which must have room for
+// cmd->num_runs elements), leaving out unsuccessful runs, and outliers if
+// they're excluded, and return how many were copied.
+//
+
+int outliers_vals(Conf *conf, Cmd *cmd, enum Metric m, int64_t *vals)
+{
+    bool exclude = conf->exclude_outliers && cmd->outliers != NULL;
+    int n = 0;
+    for (int i = 0; i < cmd->num_runs; i += 1) {
+        if (RUN_IS_OK(cmd, i) && !(exclude && cmd->outliers[i]))
+            vals[n++] = cmd->samples[m][i];
+    }
+    return n;
+}
+
+
+
+//
+// Calculate robust estimators of metric m over all of cmd's successful runs
+// (outliers included, as the estimators are meant to be insensitive to them).
+//
+
+void outliers_robust(Cmd *cmd, enum Metric m, Robust *r)
+{
+    int n;
+    int64_t *xs = sorted_vals(cmd, m, &n);
+    if (n == 0) {
+        r->trimmed_mean = r->mad = r->iqr = NAN;
+        free(xs);
+        return;
+    }
+
+    int trim = (int) (n * TRIM);
+    double sum = 0;
+    for (int i = trim; i < n - trim; i += 1)
+        sum += xs[i];
+    double scale = metric_scales[m];
+    r->trimmed_mean = sum / (n - 2 * trim) * scale;
+    r->mad = mad(xs, n, stats_quantile(xs, n, 0.5)) * scale;
+    r->iqr = (stats_quantile(xs, n, 0.75) - stats_quantile(xs, n, 0.25))
+      * scale;
+    free(xs);
+}
+
+
+
+//
+// Return a sorted copy of cmd's values of metric m for its successful runs,
+// setting *n to how many there are. The caller must free it.
+//
+
+int64_t *sorted_vals(Cmd *cmd, enum Metric m, int *n)
+{
+    int64_t *xs = malloc((cmd->num_runs + 1) * sizeof(int64_t));
+    if (xs == NULL)
+        errx(1, "Out of memory.");
+    *n = 0;
+    for (int i = 0; i < cmd->num_runs; i += 1) {
+        if (RUN_IS_OK(cmd, i))
+            xs[(*n)++] = cmd->samples[m][i];
+    }
+    qsort(xs, *n, sizeof(int64_t), cmp_int64);
+    return xs;
+}
+
+
+
+//
+// Return the median absolute deviation of the n sorted values in xs, whose
+// median is med.
+//
+
+double mad(const int64_t *xs, int n, double med)
+{
+    int64_t *ds = malloc(n * sizeof(int64_t));
+    if (ds == NULL)
+        errx(1, "Out of memory.");
+    for (int i = 0; i < n; i += 1)
+        ds[i] = llround(fabs(xs[i] - med));
+    qsort(ds, n, sizeof(int64_t), cmp_int64);
+    double d = stats_quantile(ds, n, 0.5);
+    free(ds);
+    return d;
+}
@@ -0,0 +1,276 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Capturing runs' stdout.
+//
+// If a run's output is to be checked (-o) or digested (--digest), its stdout
+// is captured in an anonymous in-memory file (a memfd, where available). Once
+// the run has finished, the output is digested in place (via mmap) and handed
+// to the checker with sendfile, so that it is never copied through user
+// space.
+//
+
+#include "Config.h"
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef MT_HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+
+#include "multitime.h"
+#include "output.h"
+
+
+
+#define COPY_SIZE (1024 * 1024) // Max bytes to copy per sendfile/read.
+
+bool send_output(int, int, off_t);
+
+
+
+//
+// If run's stdout needs to be captured, create the file it will be captured
+// in (run->out_fd), otherwise set run->out_fd to -1.
+//
+
+void output_open(Conf *conf, Run *run)
+{
+    run->out_fd = -1;
+    if (run->output_cmd == NULL && !conf->digest)
+        return;
+
+#   ifdef MT_HAVE_MEMFD_CREATE
+    run->out_fd = memfd_create("multitime-output", MFD_CLOEXEC);
+    if (run->out_fd == -1)
+        err(1, "Can't create memfd");
+#   else
+    char outtmpp[] = "/tmp/mt.XXXXXXXXXX";
+    umask(S_IRWXG | S_IRWXO | S_IXUSR);
+    run->out_fd = mkstemp(outtmpp);
+    if (run->out_fd == -1)
+        errx(1, "Can't create temporary file.");
+    fcntl(run->out_fd, F_SETFD, FD_CLOEXEC);
+    unlink(outtmpp);
+#   endif
+}
+
+
+
+//
+// Once run has finished, digest its captured output into *digest (if
+// --digest is on) and pipe it to its output command (if it has one), exiting
+// if that fails.
+//
+
+void output_finish(Conf *conf, Run *run, uint64_t *digest)
+{
+    if (run->out_fd == -1)
+        return;
+
+    struct stat sb;
+    if (fstat(run->out_fd, &sb) == -1)
+        err(1, "Can't stat captured output");
+
+    if (conf->digest) {
+        if (sb.st_size == 0)
+            *digest = xxh64(NULL, 0, 0);
+        else {
+            void *p = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE,
+              run->out_fd, 0);
+            if (p == MAP_FAILED)
+                err(1, "Can't map captured output");
+            *digest = xxh64(p, sb.st_size, 0);
+            munmap(p, sb.st_size);
+        }
+    }
+
+    if (run->output_cmd) {
+        FILE *cmdf = popen(run->output_cmd, "w");
+        if (cmdf == NULL || !send_output(run->out_fd, fileno(cmdf), sb.st_size))
+            errx(1, "Error when attempting to run %s", run->output_cmd);
+        if (pclose(cmdf) != 0)
+            errx(1, "Exiting because '%s' failed.", run->output_cmd);
+        free(run->output_cmd);
+        run->output_cmd = NULL;
+    }
+
+    close(run->out_fd);
+    run->out_fd = -1;
+}
+
+
+
+//
+// Write the first size bytes of the file fd to the pipe pfd. Returns true on
+// success.
+//
+
+bool send_output(int fd, int pfd, off_t size)
+{
+    off_t off = 0;
+#   ifdef MT_HAVE_SENDFILE
+    while (off < size) {
+        ssize_t n = sendfile(pfd, fd, &off, size - off < COPY_SIZE
+          ? size - off : COPY_SIZE);
+        if (n <= 0)
+            break;
+    }
+    if (off == size)
+        return true;
+    if (errno != EINVAL && errno != ENOSYS)
+        return false;
+#   endif
+
+    char *buf = malloc(COPY_SIZE);
+    if (buf == NULL)
+        return false;
+    bool ok = true;
+    while (ok && off < size) {
+        ssize_t r = pread(fd, buf, COPY_SIZE, off);
+        ok = r > 0;
+        for (ssize_t w = 0; ok && w < r;) {
+            ssize_t n = write(pfd, buf + w, r - w);
+            ok = n != -1;
+            w += n;
+        }
+        off += r;
+    }
+    free(buf);
+
+    return ok;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// XXH64
+//
+// A fast non-cryptographic hash (https://github.com/Cyan4973/xxHash): we only
+// need to spot outputs which differ by accident, not by malice.
+//
+
+#define XXH_P1 UINT64_C(11400714785074694791)
+#define XXH_P2 UINT64_C(14029467366897019727)
+#define XXH_P3 UINT64_C(1609587929392839161)
+#define XXH_P4 UINT64_C(9650029242287828579)
+#define XXH_P5 UINT64_C(2870177450012600261)
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i -= 1)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static inline uint64_t read32(const unsigned char *p)
+{
+    return (uint64_t) p[0] | (uint64_t) p[1] << 8 | (uint64_t) p[2] << 16
+      | (uint64_t) p[3] << 24;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_P2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_P1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t val)
+{
+    acc ^= xxh_round(0, val);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+
+
+//
+// Return the XXH64 hash of the len bytes at p, with the given seed.
+//
+
+uint64_t xxh64(const unsigned char *p, size_t len, uint64_t seed)
+{
+    const unsigned char *end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + XXH_P1 + XXH_P2, v2 = seed + XXH_P2, v3 = seed,
+          v4 = seed - XXH_P1;
+        const unsigned char *limit = end - 32;
+        do {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    }
+    else
+        h = seed + XXH_P5;
+    h += len;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxh_round(0, read64(p));
+        h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+    }
+    if (p + 4 <= end) {
+        h ^= read32(p) * XXH_P1;
+        h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+        p += 4;
+    }
+    for (; p < end; p += 1) {
+        h ^= *p * XXH_P5;
+        h = rotl64(h, 11) * XXH_P1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+
+    return h;
+}
@@ -0,0 +1,208 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Hardware and software performance counters (Linux's perf_event_open).
+//
+// Counters are attached to a run's child after it has been forked, but before
+// it execs (so this needs an engine where the child waits for us), and are
+// enabled by the exec itself. They are inherited by any processes the command
+// starts. The hardware counters are opened as a group, so that the kernel
+// schedules them onto the PMU together and derived values such as IPC compare
+// like with like; if the PMU is oversubscribed, counts are scaled up by the
+// proportion of time each counter actually ran.
+//
+
+#include "Config.h"
+
+#include <err.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef MT_HAVE_PERF_EVENT
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include "multitime.h"
+#include "perf.h"
+
+#ifdef MT_HAVE_PERF_EVENT
+
+// The events opened for each run, in the order of Run's perf_fds. The first
+// four are the hardware group, led by the first.
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+    enum Metric metric;
+} perf_events[NUM_PERF_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, METRIC_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, METRIC_INSTRS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, METRIC_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, METRIC_BRANCH_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, METRIC_TASK_CLOCK},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, METRIC_CTX_SWITCHES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, METRIC_PAGE_FAULTS},
+};
+#define NUM_HW_EVENTS 4
+
+#ifndef PERF_FLAG_FD_CLOEXEC
+#define PERF_FLAG_FD_CLOEXEC 0
+#endif
+
+int perf_event_open(int, pid_t, int, bool);
+
+#endif
+
+
+
+//
+// Check that performance counters can be used at all, and whether hardware
+// counters are available (they often aren't in virtual machines), setting
+// conf->perf_hw accordingly.
+//
+
+void perf_probe(Conf *conf)
+{
+#   ifdef MT_HAVE_PERF_EVENT
+    int fd = perf_event_open(NUM_HW_EVENTS, 0, -1, false);
+    if (fd == -1)
+        err(1, "Can't open performance counters");
+    close(fd);
+
+    fd = perf_event_open(0, 0, -1, false);
+    if (fd == -1) {
+        conf->perf_hw = false;
+        warnx("Hardware performance counters are unavailable: only recording "
+          "software events.");
+    }
+    else {
+        conf->perf_hw = true;
+        close(fd);
+    }
+#   else
+    errx(1, "Performance counters are not supported on this platform.");
+#   endif
+}
+
+
+
+//
+// Attach run's counters to pid, which must not yet have exec'd.
+//
+
+void perf_open(Conf *conf, Run *run, pid_t pid)
+{
+#   ifdef MT_HAVE_PERF_EVENT
+    for (int i = 0; i < NUM_PERF_EVENTS; i += 1) {
+        run->perf_fds[i] = -1;
+        if (i < NUM_HW_EVENTS && !conf->perf_hw)
+            continue;
+        int group = i > 0 && i < NUM_HW_EVENTS ? run->perf_fds[0] : -1;
+        run->perf_fds[i] = perf_event_open(i, pid, group, true);
+        if (run->perf_fds[i] == -1)
+            err(1, "Can't open performance counter for %s",
+              metric_names[perf_events[i].metric]);
+    }
+#   endif
+}
+
+
+
+//
+// Read (and close) run's counters, storing their values in vals (which must
+// have NUM_METRICS elements).
+//
+
+void perf_read(Conf *conf, Run *run, int64_t *vals)
+{
+#   ifdef MT_HAVE_PERF_EVENT
+    for (int i = 0; i < NUM_PERF_EVENTS; i += 1) {
+        if (run->perf_fds[i] == -1)
+            continue;
+
+        // The count, and how long the counter was enabled and running for.
+        uint64_t buf[3];
+        if (read(run->perf_fds[i], buf, sizeof(buf)) != sizeof(buf))
+            err(1, "Can't read performance counter");
+        close(run->perf_fds[i]);
+        run->perf_fds[i] = -1;
+
+        int64_t val = 0;
+        if (buf[2] > 0)
+            val = (int64_t) ((long double) buf[0] * buf[1] / buf[2]);
+        vals[perf_events[i].metric] = val;
+    }
+
+    if (conf->perf_hw && vals[METRIC_CYCLES] > 0)
+        vals[METRIC_IPC] = (int64_t) ((long double) vals[METRIC_INSTRS]
+          * 1000000 / vals[METRIC_CYCLES]);
+#   endif
+}
+
+
+
+#ifdef MT_HAVE_PERF_EVENT
+
+//
+// Open perf_events[i] for pid (0 = ourselves) in group (-1 = its own group).
+// If on_exec is true, the counter is inherited by pid's children, and starts
+// counting when pid execs. Returns the counter's fd, or -1 on error.
+//
+
+int perf_event_open(int i, pid_t pid, int group, bool on_exec)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perf_events[i].type;
+    attr.config = perf_events[i].config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+      | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_hv = 1;
+    if (on_exec) {
+        attr.disabled = group == -1;
+        attr.enable_on_exec = group == -1;
+        attr.inherit = 1;
+    }
+
+    int fd = syscall(SYS_perf_event_open, &attr, pid, -1, group,
+      PERF_FLAG_FD_CLOEXEC);
+    if (fd == -1 && errno == EACCES) {
+        // Unprivileged users may not be allowed to count kernel events.
+        attr.exclude_kernel = 1;
+        fd = syscall(SYS_perf_event_open, &attr, pid, -1, group,
+          PERF_FLAG_FD_CLOEXEC);
+    }
+
+    return fd;
+}
+
+#endif
@@ -0,0 +1,462 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// In-run resource sampling.
+//
+// getrusage only tells us a run's totals once it has finished. To see how a
+// run's memory and CPU use change while it executes, its process tree (the
+// command and its live descendants) is sampled every conf->sample_interval
+// seconds from /proc, recording the tree's total resident set size, CPU time
+// and number of threads. Rather than blocking in wait4, we poll each run's
+// pidfd with a timeout of when its next sample is due, so sampling never
+// delays noticing that a run has finished.
+//
+
+#include "Config.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "multitime.h"
+#include "export.h"
+#include "sample.h"
+
+
+
+// What we need from a process's /proc/<pid>/stat.
+
+typedef struct {
+    pid_t pid, ppid;
+    char state;
+    int64_t cpu;               // CPU time of the process and its reaped
+                               // children, in clock ticks.
+    int64_t rss;               // In pages.
+    int threads;
+} Proc;
+
+// True if /proc/<pid>/task/<tid>/children is available, so that a process's
+// children can be found without scanning every process.
+static bool have_children;
+static long clock_ticks, page_kb;
+static FILE *samples_f;
+
+void sample_take(Run *, int64_t);
+void sample_tree_children(pid_t, Sample *);
+void sample_tree_scan(pid_t, Sample *);
+bool read_stat(pid_t, Proc *);
+void add_proc(Sample *, Proc *);
+int64_t ns_now(void);
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Waiting and sampling
+//
+
+//
+// Check that sampling is possible, and open the samples export file.
+//
+
+void sample_probe(Conf *conf)
+{
+#   ifdef MT_HAVE_PIDFD
+    int fd = syscall(SYS_pidfd_open, getpid(), 0);
+    if (fd == -1)
+        err(1, "--sample-interval needs pidfd_open (Linux 5.3 or later)");
+    close(fd);
+#   endif
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task/%d/children", (int) getpid(),
+      (int) getpid());
+    have_children = access(path, R_OK) == 0;
+    clock_ticks = sysconf(_SC_CLK_TCK);
+    page_kb = sysconf(_SC_PAGESIZE) / 1024;
+
+    if (conf->export_samples) {
+        samples_f = export_open(conf->export_samples);
+        fprintf(samples_f, "cmd,run,time,rss,cpu,threads\r\n");
+    }
+}
+
+
+
+//
+// Start sampling run, which has just been launched.
+//
+
+void sample_start(Conf *conf, Run *run)
+{
+#   ifdef MT_HAVE_PIDFD
+    run->pidfd = syscall(SYS_pidfd_open, run->pid, 0);
+    if (run->pidfd == -1)
+        err(1, "Can't open pidfd");
+#   endif
+    run->next_sample = (int64_t) run->startt.tv_sec * 1000000000
+      + run->startt.tv_nsec + (int64_t) (conf->sample_interval * 1000000000);
+    run->samples = NULL;
+    run->num_samples = run->samples_cap = 0;
+}
+
+
+
+//
+// Sample the runs (an array of num_runs elements, where those with a pid of 0
+// aren't running) as they fall due, until at least one of them has exited
+// (though it isn't reaped).
+//
+
+void sample_wait(Conf *conf, Run *runs, int num_runs)
+{
+#   ifdef MT_HAVE_PIDFD
+    int64_t interval = (int64_t) (conf->sample_interval * 1000000000);
+    struct pollfd pfds[num_runs];
+    while (true) {
+        int64_t now = ns_now();
+        int64_t timeout = INT64_MAX;
+        int n = 0;
+        for (int i = 0; i < num_runs; i += 1) {
+            Run *run = &runs[i];
+            if (run->pid == 0 || run->pidfd == -1)
+                continue;
+            if (now >= run->next_sample) {
+                sample_take(run, now);
+                run->next_sample += interval;
+                // If sampling can't keep up, skip samples rather than taking
+                // a burst of them.
+                if (run->next_sample <= now)
+                    run->next_sample = now + interval;
+            }
+            if (run->next_sample - now < timeout)
+                timeout = run->next_sample - now;
+            pfds[n++] = (struct pollfd) {.fd = run->pidfd, .events = POLLIN};
+        }
+        if (n == 0)
+            return;
+
+        struct timespec ts = {timeout / 1000000000, timeout % 1000000000};
+        int r = ppoll(pfds, n, &ts, NULL);
+        if (r == -1 && errno != EINTR)
+            err(1, "Error when waiting for a run to finish");
+        if (r > 0)
+            return;
+    }
+#   endif
+}
+
+
+
+//
+// Take one sample of run's process tree at time now.
+//
+
+void sample_take(Run *run, int64_t now)
+{
+    Sample s = {0};
+    if (have_children)
+        sample_tree_children(run->pid, &s);
+    else
+        sample_tree_scan(run->pid, &s);
+    // A run which has exited (but not yet been reaped) has nothing left to
+    // sample.
+    if (s.threads == 0)
+        return;
+    s.t = now - ((int64_t) run->startt.tv_sec * 1000000000
+      + run->startt.tv_nsec);
+
+    if (run->num_samples == run->samples_cap) {
+        run->samples_cap = run->samples_cap == 0 ? 64 : run->samples_cap * 2;
+        run->samples = realloc(run->samples, sizeof(Sample) * run->samples_cap);
+        if (run->samples == NULL)
+            errx(1, "Out of memory.");
+    }
+    run->samples[run->num_samples++] = s;
+}
+
+
+
+//
+// Summarise run's samples into vals (which must have NUM_METRICS elements),
+// export them, and stop sampling run.
+//
+
+void sample_finish(Conf *conf, Run *run, int64_t *vals)
+{
+    if (run->pidfd != -1) {
+        close(run->pidfd);
+        run->pidfd = -1;
+    }
+
+    int64_t rss_peak = 0, rss_sum = 0, cpu_peak = 0, prev_t = 0, prev_cpu = 0;
+    int threads = 0;
+    for (int i = 0; i < run->num_samples; i += 1) {
+        Sample *s = &run->samples[i];
+        if (s->rss > rss_peak)
+            rss_peak = s->rss;
+        rss_sum += s->rss;
+        if (s->threads > threads)
+            threads = s->threads;
+        // CPU utilisation is in hundredths of a percent of one CPU.
+        if (s->t > prev_t) {
+            int64_t u = (s->cpu - prev_cpu) * 10000 / (s->t - prev_t);
+            if (u > cpu_peak)
+                cpu_peak = u;
+        }
+        prev_t = s->t;
+        prev_cpu = s->cpu;
+    }
+    vals[METRIC_RSS_PEAK] = rss_peak;
+    vals[METRIC_RSS_MEAN] = run->num_samples > 0
+      ? rss_sum / run->num_samples : 0;
+    vals[METRIC_CPU_MEAN] = prev_t > 0 ? prev_cpu * 10000 / prev_t : 0;
+    vals[METRIC_CPU_PEAK] = cpu_peak;
+    vals[METRIC_THREADS] = threads;
+
+    if (samples_f) {
+        int cmdi = 0;
+        while (conf->cmds[cmdi] != run->cmd)
+            cmdi += 1;
+        for (int i = 0; i < run->num_samples; i += 1) {
+            Sample *s = &run->samples[i];
+            fprintf(samples_f, "%d,%d,%.9f,%" PRId64 ",%.9f,%d\r\n", cmdi + 1,
+              run->runi + 1, (double) s->t / 1000000000, s->rss,
+              (double) s->cpu / 1000000000, s->threads);
+        }
+    }
+
+    free(run->samples);
+    run->samples = NULL;
+    run->num_samples = run->samples_cap = 0;
+}
+
+
+
+//
+// Close the samples export file.
+//
+
+void sample_close(Conf *conf)
+{
+    if (samples_f)
+        export_close(samples_f, conf->export_samples);
+}
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Process trees
+//
+
+//
+// Add the process tree rooted at root to s, finding each process's children
+// from the children files of its threads. Processes which exit while we're
+// doing so are silently skipped.
+//
+
+void sample_tree_children(pid_t root, Sample *s)
+{
+    pid_t *stack = malloc(sizeof(pid_t) * 16);
+    int stack_len = 0, stack_cap = 16;
+    if (stack == NULL)
+        errx(1, "Out of memory.");
+    stack[stack_len++] = root;
+    while (stack_len > 0) {
+        pid_t pid = stack[--stack_len];
+        Proc p;
+        if (!read_stat(pid, &p))
+            continue;
+        add_proc(s, &p);
+
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/task", (int) pid);
+        DIR *d = opendir(path);
+        if (d == NULL)
+            continue;
+        struct dirent *de;
+        while ((de = readdir(d)) != NULL) {
+            if (!isdigit((unsigned char) de->d_name[0]))
+                continue;
+            char cpath[sizeof(path) + sizeof(de->d_name) + 16];
+            snprintf(cpath, sizeof(cpath), "%s/%s/children", path, de->d_name);
+            FILE *f = fopen(cpath, "r");
+            if (f == NULL)
+                continue;
+            int child;
+            while (fscanf(f, "%d", &child) == 1) {
+                if (stack_len == stack_cap) {
+                    stack_cap *= 2;
+                    stack = realloc(stack, sizeof(pid_t) * stack_cap);
+                    if (stack == NULL)
+                        errx(1, "Out of memory.");
+                }
+                stack[stack_len++] = child;
+            }
+            fclose(f);
+        }
+        closedir(d);
+    }
+    free(stack);
+}
+
+
+
+//
+// Add the process tree rooted at root to s, finding it by reading the stat of
+// every process on the system (for kernels without children files).
+//
+
+void sample_tree_scan(pid_t root, Sample *s)
+{
+    DIR *d = opendir("/proc");
+    if (d == NULL)
+        err(1, "Can't open /proc");
+    Proc *procs = NULL;
+    int num_procs = 0, procs_cap = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (!isdigit((unsigned char) de->d_name[0]))
+            continue;
+        if (num_procs == procs_cap) {
+            procs_cap = procs_cap == 0 ? 256 : procs_cap * 2;
+            procs = realloc(procs, sizeof(Proc) * procs_cap);
+            if (procs == NULL)
+                errx(1, "Out of memory.");
+        }
+        if (read_stat(atoi(de->d_name), &procs[num_procs]))
+            num_procs += 1;
+    }
+    closedir(d);
+
+    // Repeatedly sweep the processes, moving those whose parent is in the tree
+    // to the front (into the tree) until a sweep adds nothing.
+    int in_tree = 0;
+    for (int i = 0; i < num_procs; i += 1) {
+        if (procs[i].pid == root) {
+            Proc t = procs[0];
+            procs[0] = procs[i];
+            procs[i] = t;
+            in_tree = 1;
+            break;
+        }
+    }
+    bool changed = in_tree > 0;
+    while (changed) {
+        changed = false;
+        for (int i = in_tree; i < num_procs; i += 1) {
+            for (int j = 0; j < in_tree; j += 1) {
+                if (procs[i].ppid == procs[j].pid) {
+                    Proc t = procs[in_tree];
+                    procs[in_tree] = procs[i];
+                    procs[i] = t;
+                    in_tree += 1;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+    for (int i = 0; i < in_tree; i += 1)
+        add_proc(s, &procs[i]);
+    free(procs);
+}
+
+
+
+//
+// Read the stat of process pid into p, returning false if it can't be read
+// (e.g. because the process has exited).
+//
+
+bool read_stat(pid_t pid, Proc *p)
+{
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return false;
+    size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+
+    // The command name (field 2) is in parentheses and may contain anything,
+    // so fields are counted from the last closing parenthesis.
+    char *q = strrchr(buf, ')');
+    if (q == NULL)
+        return false;
+    long long utime, stime, cutime, cstime, threads, rss;
+    int ppid;
+    if (sscanf(q + 2, "%c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lld %lld "
+      "%lld %lld %*d %*d %lld %*d %*u %*u %lld", &p->state, &ppid, &utime,
+      &stime, &cutime, &cstime, &threads, &rss) != 8)
+        return false;
+    p->pid = pid;
+    p->ppid = ppid;
+    p->cpu = utime + stime + cutime + cstime;
+    p->rss = rss;
+    p->threads = (int) threads;
+    return true;
+}
+
+
+
+//
+// Add process p (unless it's a zombie, which uses no resources) to s.
+//
+
+void add_proc(Sample *s, Proc *p)
+{
+    if (p->state == 'Z')
+        return;
+    s->rss += p->rss * page_kb;
+    s->cpu += p->cpu * 1000000000 / clock_ticks;
+    s->threads += p->threads;
+}
+
+
+
+//
+// Return the current time of MT_CLOCK in ns.
+//
+
+int64_t ns_now(void)
+{
+    struct timespec ts;
+    clock_gettime(MT_CLOCK, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
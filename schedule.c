@@ -0,0 +1,218 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Run schedules.
+//
+// conf->schedule decides the order in which the runs of the commands are
+// executed:
+//
+//   random      a uniformly random shuffle of every run.
+//   interleave  one run of each command in turn.
+//   block       every run of the first command, then every run of the second,
+//               and so on.
+//   abba        rounds of one run of each command, alternately in forward and
+//               reverse order (so that two commands A and B run ABBAABBA...),
+//               which cancels out a linear drift in the machine's speed.
+//
+// When the number of runs is fixed, the whole schedule is built before the
+// first run is started. The exception is --stream, which must use the same
+// amount of memory however many runs there are: there, each run's command is
+// picked as it is started, random schedules picking each command with
+// probability proportional to its remaining runs, which gives the same
+// distribution of schedules as a shuffle. In adaptive mode, commands drop out
+// as they converge, so each run's command is picked, from those still needing
+// runs, as it is started.
+//
+// Every random choice (including the length of sleeps between runs) comes
+// from a generator seeded by --seed, so that a schedule can be replayed.
+//
+
+#include "Config.h"
+
+#include <err.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "multitime.h"
+#include "schedule.h"
+#include "stats.h"
+
+
+
+const char *schedule_names[] = {"random", "interleave", "block", "abba", NULL};
+
+
+
+
+//
+// Seed the random number generator (from the time, unless --seed was given)
+// and, if the number of runs is fixed, build the schedule.
+//
+
+void schedule_init(Conf *conf)
+{
+    if (!conf->has_seed) {
+        uint64_t state = (uint64_t) time(NULL) ^ ((uint64_t) getpid() << 32);
+        conf->seed = rng_next(&state);
+    }
+    conf->rng = conf->seed;
+    conf->sched_pos = 0;
+    conf->sched_last = -1;
+    conf->sched_dir = 1;
+    if (conf->verbosity > 0)
+        fprintf(stderr, "===> Schedule %s, seed %ju\n",
+          schedule_names[conf->schedule], (uintmax_t) conf->seed);
+
+    if (conf->adaptive || conf->stream)
+        return;
+
+    if (conf->num_runs > INT_MAX / conf->num_cmds)
+        errx(1, "Too many runs to schedule.");
+    int n = conf->num_cmds * conf->num_runs;
+    conf->sched = malloc(n * sizeof(int));
+    if (conf->sched == NULL)
+        errx(1, "Out of memory.");
+
+    if (conf->schedule == SCHEDULE_RANDOM) {
+        // A Fisher-Yates shuffle.
+        for (int p = 0; p < n; p += 1)
+            conf->sched[p] = p / conf->num_runs;
+        for (int p = n - 1; p > 0; p -= 1) {
+            int q = (int) schedule_randn(conf, p + 1);
+            int t = conf->sched[p];
+            conf->sched[p] = conf->sched[q];
+            conf->sched[q] = t;
+        }
+        return;
+    }
+
+    int left[conf->num_cmds];
+    for (int i = 0; i < conf->num_cmds; i += 1)
+        left[i] = conf->num_runs;
+    for (int p = 0; p < n; p += 1) {
+        int i = schedule_pick(conf, left);
+        conf->sched[p] = i;
+        left[i] -= 1;
+    }
+}
+
+
+
+//
+// Pick the command of the next run when the number of runs is fixed, storing
+// it in *cmdp. Returns false if every run has been started.
+//
+
+bool schedule_next(Conf *conf, Cmd **cmdp)
+{
+    int i;
+    if (conf->sched != NULL) {
+        if (conf->sched_pos == conf->num_cmds * conf->num_runs)
+            return false;
+        i = conf->sched[conf->sched_pos];
+    }
+    else {
+        int left[conf->num_cmds];
+        bool any = false;
+        for (int j = 0; j < conf->num_cmds; j += 1) {
+            left[j] = conf->num_runs - conf->cmds[j]->num_started;
+            if (left[j] > 0)
+                any = true;
+        }
+        if (!any)
+            return false;
+        i = schedule_pick(conf, left);
+    }
+    conf->sched_pos += 1;
+    *cmdp = conf->cmds[i];
+
+    return true;
+}
+
+
+
+//
+// Return the index of the command which should execute next, given that
+// command i has left[i] runs still to start (at least one of which must be
+// non-zero). Random schedules pick each command with probability proportional
+// to left[i].
+//
+
+int schedule_pick(Conf *conf, const int *left)
+{
+    int n = conf->num_cmds, i = 0;
+    switch (conf->schedule) {
+        case SCHEDULE_RANDOM: {
+            uint64_t total = 0;
+            for (i = 0; i < n; i += 1)
+                total += left[i];
+            uint64_t r = schedule_randn(conf, total);
+            for (i = 0; r >= (uint64_t) left[i]; i += 1)
+                r -= left[i];
+            break;
+        }
+        case SCHEDULE_INTERLEAVE:
+            i = (conf->sched_last + 1) % n;
+            while (left[i] == 0)
+                i = (i + 1) % n;
+            break;
+        case SCHEDULE_BLOCK:
+            while (left[i] == 0)
+                i += 1;
+            break;
+        case SCHEDULE_ABBA:
+            // Sweep back and forth over the commands, so that the command at
+            // each end of a sweep runs twice in a row.
+            i = conf->sched_last + conf->sched_dir;
+            while (i >= 0 && i < n && left[i] == 0)
+                i += conf->sched_dir;
+            if (i < 0 || i == n) {
+                conf->sched_dir = -conf->sched_dir;
+                i = conf->sched_last;
+                while (left[i] == 0)
+                    i += conf->sched_dir;
+            }
+            break;
+    }
+    conf->sched_last = i;
+
+    return i;
+}
+
+
+
+//
+// Return a random number in [0, n) from conf's seeded generator. The modulo
+// bias is at most n / 2^64.
+//
+
+uint64_t schedule_randn(Conf *conf, uint64_t n)
+{
+    return rng_next(&conf->rng) % n;
+}
@@ -0,0 +1,350 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#include "Config.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "multitime.h"
+#include "stats.h"
+
+
+
+//
+// Convert a run which took real_ns ns and used resources ru into a value per
+// metric, stored in vals (which must have NUM_METRICS elements). Times are in
+// ns; performance counters are left as 0.
+//
+
+void run_metrics(int64_t real_ns, struct rusage *ru, int64_t *vals)
+{
+    vals[METRIC_REAL] = real_ns;
+    vals[METRIC_USER] = (int64_t) ru->ru_utime.tv_sec * 1000000000
+      + (int64_t) ru->ru_utime.tv_usec * 1000;
+    vals[METRIC_SYS] = (int64_t) ru->ru_stime.tv_sec * 1000000000
+      + (int64_t) ru->ru_stime.tv_usec * 1000;
+    vals[METRIC_MAXRSS] = ru->ru_maxrss;
+    vals[METRIC_MINFLT] = ru->ru_minflt;
+    vals[METRIC_MAJFLT] = ru->ru_majflt;
+    vals[METRIC_NSWAP] = ru->ru_nswap;
+    vals[METRIC_INBLOCK] = ru->ru_inblock;
+    vals[METRIC_OUBLOCK] = ru->ru_oublock;
+    vals[METRIC_MSGSND] = ru->ru_msgsnd;
+    vals[METRIC_MSGRCV] = ru->ru_msgrcv;
+    vals[METRIC_NSIGNALS] = ru->ru_nsignals;
+    vals[METRIC_NVCSW] = ru->ru_nvcsw;
+    vals[METRIC_NIVCSW] = ru->ru_nivcsw;
+    for (enum Metric m = FIRST_PERF_METRIC; m < NUM_METRICS; m += 1)
+        vals[m] = 0;
+}
+
+
+
+//
+// Calculate the mean, (population) standard deviation, min and max of the n
+// values in xs in a single pass. The sum is kept as an exact integer; the
+// sum of squares is taken relative to xs[0], so that it doesn't lose
+// precision when the values are large but close together.
+//
+
+void stats_moments(const int64_t *xs, int n, double *mean, double *stddev,
+  int64_t *min, int64_t *max)
+{
+    int64_t shift = xs[0], sum = 0, lo = xs[0], hi = xs[0];
+    double sumsq = 0;
+    for (int i = 0; i < n; i += 1) {
+        int64_t x = xs[i];
+        double d = x - shift;
+        sum += x;
+        sumsq += d * d;
+        lo = x < lo ? x : lo;
+        hi = x > hi ? x : hi;
+    }
+
+    *mean = (double) sum / n;
+    double dmean = *mean - shift;
+    double var = sumsq / n - dmean * dmean;
+    *stddev = var > 0 ? sqrt(var) : 0;
+    *min = lo;
+    *max = hi;
+}
+
+
+
+//
+// Return the k'th (from 0) smallest of the n values in xs, partially
+// reordering xs in the process: afterwards, every value before index k is no
+// bigger than the result, and every value after it no smaller.
+//
+
+int64_t stats_select(int64_t *xs, int n, int k)
+{
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        // Median-of-three pivot, which avoids quadratic behaviour on already
+        // sorted input.
+        int mid = lo + (hi - lo) / 2;
+        int64_t a = xs[lo], b = xs[mid], c = xs[hi];
+        int64_t pivot = a < b ? (b < c ? b : (a < c ? c : a))
+          : (a < c ? a : (b < c ? c : b));
+
+        int i = lo, j = hi;
+        while (i <= j) {
+            while (xs[i] < pivot)
+                i += 1;
+            while (xs[j] > pivot)
+                j -= 1;
+            if (i <= j) {
+                int64_t t = xs[i];
+                xs[i] = xs[j];
+                xs[j] = t;
+                i += 1;
+                j -= 1;
+            }
+        }
+        if (k <= j)
+            hi = j;
+        else if (k >= i)
+            lo = i;
+        else
+            break;
+    }
+
+    return xs[k];
+}
+
+
+
+//
+// Return the median of the n values in xs, partially reordering xs.
+//
+
+double stats_median(int64_t *xs, int n)
+{
+    int64_t md = stats_select(xs, n, (n - 1) / 2);
+    if (n % 2 == 1)
+        return md;
+
+    // The upper middle value is the smallest of those after the lower one.
+    int64_t next = xs[n / 2];
+    for (int i = n / 2 + 1; i < n; i += 1)
+        next = xs[i] < next ? xs[i] : next;
+    return ((double) md + next) / 2;
+}
+
+
+
+//
+// Return the q'th (0 <= q <= 1) quantile of the n sorted values in xs, using
+// linear interpolation between the closest ranks (Hyndman and Fan's type 7,
+// as used by R and NumPy by default).
+//
+
+double stats_quantile(const int64_t *xs, int n, double q)
+{
+    double h = (n - 1) * q;
+    int lo = (int) h;
+    if (lo >= n - 1)
+        return xs[n - 1];
+    return xs[lo] + (h - lo) * (double) (xs[lo + 1] - xs[lo]);
+}
+
+
+
+//
+// As stats_quantile, but for doubles.
+//
+
+double stats_quantile_double(const double *xs, int n, double q)
+{
+    double h = (n - 1) * q;
+    int lo = (int) h;
+    if (lo >= n - 1)
+        return xs[n - 1];
+    return xs[lo] + (h - lo) * (xs[lo + 1] - xs[lo]);
+}
+
+
+
+//
+// The standard normal cumulative distribution function.
+//
+
+double stats_norm_cdf(double x)
+{
+    return 0.5 * erfc(-x / sqrt(2));
+}
+
+
+
+//
+// The inverse of stats_norm_cdf, for 0 < p < 1, using Acklam's rational
+// approximation (relative error below 1.15e-9).
+//
+
+double stats_norm_inv(double p)
+{
+    static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02,
+      -2.759285104469687e+02, 1.383577518672690e+02, -3.066479806614716e+01,
+      2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02,
+      -1.556989798598866e+02, 6.680131188771972e+01, -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01,
+      -2.400758277161838e+00, -2.549732539343734e+00, 4.374664141464968e+00,
+      2.938163982698783e+00};
+    static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01,
+      2.445134137142996e+00, 3.754408661907416e+00};
+    double q, r;
+
+    if (p < 0.02425) {
+        q = sqrt(-2 * log(p));
+        return (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q
+          + c[5]) / ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+    }
+    else if (p > 1 - 0.02425) {
+        q = sqrt(-2 * log(1 - p));
+        return -(((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q
+          + c[5]) / ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+    }
+
+    q = p - 0.5;
+    r = q * q;
+    return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r
+      + a[5]) * q / (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4])
+      * r + 1);
+}
+
+
+
+int cmp_int(const void *x, const void *y)
+{
+    int a = *((const int *) x);
+    int b = *((const int *) y);
+
+    return a < b ? -1 : a > b;
+}
+
+
+
+int cmp_int64(const void *x, const void *y)
+{
+    int64_t a = *((const int64_t *) x);
+    int64_t b = *((const int64_t *) y);
+
+    return a < b ? -1 : a > b;
+}
+
+
+
+int cmp_double(const void *x, const void *y)
+{
+    double a = *((const double *) x);
+    double b = *((const double *) y);
+
+    return a < b ? -1 : a > b;
+}
+
+
+
+//
+// Return the regularised incomplete beta function I_x(a, b), evaluated by its
+// continued fraction (using the modified Lentz method).
+//
+
+double stats_incbeta(double a, double b, double x)
+{
+    if (x <= 0)
+        return 0;
+    if (x >= 1)
+        return 1;
+    // The continued fraction converges quickly only for x < (a + 1) /
+    // (a + b + 2); otherwise use the symmetry I_x(a, b) = 1 - I_1-x(b, a).
+    if (x > (a + 1) / (a + b + 2))
+        return 1 - stats_incbeta(b, a, 1 - x);
+
+    double front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x)
+      + b * log(1 - x)) / a;
+
+    const double tiny = 1e-300;
+    double c = 1, d = 1 - (a + b) * x / (a + 1);
+    if (fabs(d) < tiny)
+        d = tiny;
+    d = 1 / d;
+    double f = d;
+    for (int m = 1; m <= 300; m += 1) {
+        // Even step.
+        double num = m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m));
+        d = 1 + num * d;
+        d = fabs(d) < tiny ? 1 / tiny : 1 / d;
+        c = 1 + num / c;
+        if (fabs(c) < tiny)
+            c = tiny;
+        f *= c * d;
+
+        // Odd step.
+        num = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+        d = 1 + num * d;
+        d = fabs(d) < tiny ? 1 / tiny : 1 / d;
+        c = 1 + num / c;
+        if (fabs(c) < tiny)
+            c = tiny;
+        double delta = c * d;
+        f *= delta;
+        if (fabs(delta - 1) < 1e-12)
+            break;
+    }
+
+    return front * f;
+}
+
+
+
+//
+// Return the two-sided p-value of t under Student's t-distribution with df
+// degrees of freedom.
+//
+
+double stats_t_pvalue(double t, double df)
+{
+    return stats_incbeta(df / 2, 0.5, df / (df + t * t));
+}
+
+
+
+//
+// Return the next number from a splitmix64 generator (Steele et al. 2014):
+// fast, with a 2^64 period, and good enough for resampling and for shuffling
+// run schedules.
+//
+
+uint64_t rng_next(uint64_t *state)
+{
+    uint64_t z = (*state += UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
@@ -0,0 +1,36 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+void run_metrics(int64_t, struct rusage *, int64_t *);
+void stats_moments(const int64_t *, int, double *, double *, int64_t *,
+  int64_t *);
+int64_t stats_select(int64_t *, int, int);
+double stats_median(int64_t *, int);
+double stats_quantile(const int64_t *, int, double);
+double stats_quantile_double(const double *, int, double);
+double stats_norm_cdf(double);
+double stats_norm_inv(double);
+int cmp_int(const void *, const void *);
+int cmp_int64(const void *, const void *);
+int cmp_double(const void *, const void *);
+double stats_incbeta(double, double, double);
+double stats_t_pvalue(double, double);
+uint64_t rng_next(uint64_t *);
@@ -0,0 +1,335 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Persistent results.
+//
+// A store is an append-only text file to which each command's runs are added
+// as a single line, so that later invocations can be compared with them. Each
+// line has tab separated fields:
+//
+//   1 <time> <host> <label> <command> <reals> <users> <syss>
+//
+// where 1 is the format version; time is the Unix time the line was stored;
+// host is a fingerprint of the machine (see store_host); label and command are
+// escaped (see store_escape); and reals, users and syss are comma separated
+// lists of each run's times in ns. A line matches a command if its host,
+// label and command are all identical, and the last matching line wins.
+//
+
+#include "Config.h"
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "multitime.h"
+#include "compare.h"
+#include "export.h"
+#include "output.h"
+#include "store.h"
+
+
+
+#define STORE_VERSION "1"
+
+uint64_t store_host(void);
+char *store_escape(const char *);
+int store_parse_times(char *, int64_t **);
+void store_times(FILE *, Cmd *, enum Metric);
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Reading and writing
+//
+
+//
+// Find each command's most recent runs stored under the label
+// conf->compare_to on this host, and compare the command's new runs with them.
+//
+
+void store_load(Conf *conf)
+{
+    FILE *f = fopen(conf->store, "r");
+    if (f == NULL) {
+        if (errno != ENOENT)
+            err(1, "Can't open '%s'", conf->store);
+        warnx("Results store '%s' doesn't exist yet.", conf->store);
+        return;
+    }
+
+    char host[17];
+    snprintf(host, sizeof(host), "%016" PRIx64, store_host());
+    char *label = store_escape(conf->compare_to);
+    char **keys = malloc(sizeof(char *) * conf->num_cmds);
+    if (keys == NULL)
+        errx(1, "Out of memory.");
+    for (int i = 0; i < conf->num_cmds; i += 1) {
+        char *s = cmd_str(conf, conf->cmds[i]);
+        keys[i] = store_escape(s);
+        free(s);
+    }
+
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    while ((len = getline(&line, &line_size, f)) != -1) {
+        if (len > 0 && line[len - 1] == '\n')
+            line[len - 1] = '\0';
+
+        char *fields[6], *p = line;
+        int num_fields = 0;
+        while (num_fields < 6 && p != NULL)
+            fields[num_fields++] = strsep(&p, "\t");
+        // Lines written by other versions, or which are mangled, are skipped.
+        if (num_fields < 6 || strcmp(fields[0], STORE_VERSION) != 0
+          || strcmp(fields[2], host) != 0 || strcmp(fields[3], label) != 0)
+            continue;
+        for (int i = 0; i < conf->num_cmds; i += 1) {
+            Cmd *cmd = conf->cmds[i];
+            if (strcmp(fields[4], keys[i]) != 0)
+                continue;
+            int64_t *reals;
+            int n = store_parse_times(fields[5], &reals);
+            if (n == 0)
+                break;
+            if (cmd->stored != NULL)
+                free(cmd->stored->reals);
+            else if ((cmd->stored = malloc(sizeof(Stored))) == NULL)
+                errx(1, "Out of memory.");
+            cmd->stored->when = (time_t) strtoimax(fields[1], NULL, 10);
+            cmd->stored->reals = reals;
+            cmd->stored->num_runs = n;
+        }
+    }
+    if (ferror(f))
+        err(1, "Can't read '%s'", conf->store);
+    fclose(f);
+    free(line);
+
+    for (int i = 0; i < conf->num_cmds; i += 1) {
+        Cmd *cmd = conf->cmds[i];
+        free(keys[i]);
+        if (cmd->stored == NULL) {
+            warnx("No results labelled '%s' stored for command %d on this "
+              "host.", conf->compare_to, i + 1);
+            continue;
+        }
+        Cmd base = {.num_runs = cmd->stored->num_runs};
+        base.samples[METRIC_REAL] = cmd->stored->reals;
+        compare(conf, &base, cmd, &cmd->stored->cmp);
+    }
+    free(keys);
+    free(label);
+}
+
+
+
+//
+// Append each command's runs to the store, labelled conf->label.
+//
+
+void store_append(Conf *conf)
+{
+    int fd = open(conf->store, O_WRONLY | O_APPEND | O_CREAT, 0666);
+    if (fd == -1)
+        err(1, "Can't open '%s'", conf->store);
+    // Stop concurrent invocations from interleaving their lines.
+    if (flock(fd, LOCK_EX) == -1)
+        err(1, "Can't lock '%s'", conf->store);
+    FILE *f = fdopen(fd, "a");
+    if (f == NULL)
+        err(1, "Can't open '%s'", conf->store);
+
+    uint64_t host = store_host();
+    char *label = store_escape(conf->label);
+    time_t now = time(NULL);
+    for (int i = 0; i < conf->num_cmds; i += 1) {
+        Cmd *cmd = conf->cmds[i];
+        if (cmd->num_runs == cmd->num_failed + cmd->num_timed_out)
+            continue;
+        char *s = cmd_str(conf, cmd);
+        char *key = store_escape(s);
+        fprintf(f, STORE_VERSION "\t%jd\t%016" PRIx64 "\t%s\t%s\t",
+          (intmax_t) now, host, label, key);
+        store_times(f, cmd, METRIC_REAL);
+        fprintf(f, "\t");
+        store_times(f, cmd, METRIC_USER);
+        fprintf(f, "\t");
+        store_times(f, cmd, METRIC_SYS);
+        fprintf(f, "\n");
+        free(key);
+        free(s);
+    }
+    free(label);
+
+    if (fclose(f) != 0)
+        err(1, "Can't write to '%s'", conf->store);
+}
+
+
+
+//
+// Return true if cmd is significantly slower than its stored runs, by more
+// than conf->threshold percent.
+//
+
+bool store_regression(Conf *conf, Cmd *cmd)
+{
+    if (cmd->stored == NULL || cmd->stored->cmp.verdict != VERDICT_SLOWER
+      || cmd->stored->cmp.speedup <= 0)
+        return false;
+    return (1 / cmd->stored->cmp.speedup - 1) * 100 > conf->threshold;
+}
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Helpers
+//
+
+//
+// Return a fingerprint of this machine: its name, OS, architecture, CPU model
+// and number of CPUs. Results from different machines are never compared.
+//
+
+uint64_t store_host(void)
+{
+    char buf[1024];
+    struct utsname u;
+    if (uname(&u) == -1)
+        err(1, "uname");
+    int len = snprintf(buf, sizeof(buf), "%s\n%s\n%s\n%ld\n", u.nodename,
+      u.sysname, u.machine, sysconf(_SC_NPROCESSORS_CONF));
+
+    // The CPU model (Linux only: elsewhere the architecture has to do).
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (f != NULL) {
+        char *line = NULL;
+        size_t line_size = 0;
+        while (getline(&line, &line_size, f) != -1) {
+            if (strncmp(line, "model name", 10) == 0) {
+                snprintf(buf + len, sizeof(buf) - len, "%s", line);
+                break;
+            }
+        }
+        free(line);
+        fclose(f);
+    }
+
+    return xxh64((const unsigned char *) buf, strlen(buf), 0);
+}
+
+
+
+//
+// Return a newly allocated copy of s with backslashes, tabs and newlines
+// escaped, so that it can be stored as a single field.
+//
+
+char *store_escape(const char *s)
+{
+    char *e = malloc(strlen(s) * 2 + 1);
+    if (e == NULL)
+        errx(1, "Out of memory.");
+    char *p = e;
+    for (; *s != '\0'; s += 1) {
+        switch (*s) {
+            case '\\':
+                *p++ = '\\';
+                *p++ = '\\';
+                break;
+            case '\t':
+                *p++ = '\\';
+                *p++ = 't';
+                break;
+            case '\n':
+                *p++ = '\\';
+                *p++ = 'n';
+                break;
+            default:
+                *p++ = *s;
+                break;
+        }
+    }
+    *p = '\0';
+    return e;
+}
+
+
+
+//
+// Parse the comma separated times in s into a newly allocated array *times,
+// returning how many there are. Returns 0 (and allocates nothing) if s is
+// malformed.
+//
+
+int store_parse_times(char *s, int64_t **times)
+{
+    int n = 1;
+    for (char *p = s; *p != '\0'; p += 1) {
+        if (*p == ',')
+            n += 1;
+    }
+    if ((*times = malloc(sizeof(int64_t) * n)) == NULL)
+        errx(1, "Out of memory.");
+    for (int i = 0; i < n; i += 1) {
+        char *ep;
+        errno = 0;
+        intmax_t v = strtoimax(s, &ep, 10);
+        if (ep == s || errno != 0 || v < 0 || (*ep != ',' && *ep != '\0')) {
+            free(*times);
+            return 0;
+        }
+        (*times)[i] = v;
+        s = ep + 1;
+    }
+    return n;
+}
+
+
+
+//
+// Write cmd's value of metric m for each successful run, comma separated.
+//
+
+void store_times(FILE *f, Cmd *cmd, enum Metric m)
+{
+    for (int i = 0, k = 0; i < cmd->num_runs; i += 1) {
+        if (RUN_IS_OK(cmd, i))
+            fprintf(f, "%s%" PRId64, k++ > 0 ? "," : "", cmd->samples[m][i]);
+    }
+}
@@ -0,0 +1,233 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Streaming statistics.
+//
+// Each metric's mean and variance are updated online (using Welford's
+// algorithm) and its min and max are tracked exactly. Order statistics (e.g.
+// the median) are estimated from a log-linear histogram: values below
+// 2 * STREAM_SUB fall into a bucket of their own, and each power of two above
+// that is divided into STREAM_SUB equal-width buckets. A bucket's width is thus
+// at most 1 / STREAM_SUB of its lower bound so, by reporting its midpoint, an
+// estimated order statistic is within 1 / (2 * STREAM_SUB) (i.e. 0.78%) of the
+// true value. The histogram's size is fixed, no matter how many values are
+// added to it.
+//
+
+#include "Config.h"
+
+#include <err.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "multitime.h"
+#include "format.h"
+#include "histogram.h"
+#include "stream.h"
+
+#define STREAM_SUB_BITS 6
+#define STREAM_SUB (1 << STREAM_SUB_BITS)
+#define STREAM_BUCKETS (STREAM_SUB * (65 - STREAM_SUB_BITS))
+
+int stream_bucket(uint64_t);
+uint64_t stream_bucket_mid(int);
+
+
+
+void stream_init(Stream *st)
+{
+    st->n = 0;
+    st->mean = st->m2 = 0;
+    st->min = UINT64_MAX;
+    st->max = 0;
+    st->counts = NULL;
+}
+
+
+
+void stream_add(Stream *st, uint64_t v)
+{
+    if (st->counts == NULL) {
+        st->counts = calloc(STREAM_BUCKETS, sizeof(uint32_t));
+        if (st->counts == NULL)
+            errx(1, "Out of memory.");
+    }
+
+    st->n += 1;
+    double delta = v - st->mean;
+    st->mean += delta / st->n;
+    st->m2 += delta * (v - st->mean);
+    if (v < st->min)
+        st->min = v;
+    if (v > st->max)
+        st->max = v;
+    st->counts[stream_bucket(v)] += 1;
+}
+
+
+
+//
+// Add a run's metrics (as calculated by run_metrics) to streams (which must
+// have NUM_METRICS elements).
+//
+
+void stream_add_run(Stream *streams, int64_t *vals)
+{
+    for (enum Metric m = 0; m < NUM_METRICS; m += 1)
+        stream_add(&streams[m], vals[m] > 0 ? (uint64_t) vals[m] : 0);
+}
+
+
+
+//
+// Return an estimate of the k'th smallest (from 1) value added to st.
+//
+
+uint64_t stream_rank(Stream *st, uint64_t k)
+{
+    if (k <= 1)
+        return st->min;
+    if (k >= st->n)
+        return st->max;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < STREAM_BUCKETS; i += 1) {
+        seen += st->counts[i];
+        if (seen >= k) {
+            uint64_t v = stream_bucket_mid(i);
+            if (v < st->min)
+                return st->min;
+            if (v > st->max)
+                return st->max;
+            return v;
+        }
+    }
+
+    return st->max;
+}
+
+
+
+//
+// Return an estimate of the q'th (0 <= q <= 1) quantile of the values added to
+// st, interpolating between ranks as stats_quantile does.
+//
+
+double stream_quantile(Stream *st, double q)
+{
+    if (st->n == 0)
+        return NAN;
+    double h = (st->n - 1) * q;
+    uint64_t lo = (uint64_t) h;
+    double x = stream_rank(st, lo + 1);
+    return x + (h - lo) * ((double) stream_rank(st, lo + 2) - x);
+}
+
+
+
+//
+// Add the values in st (multiplied by scale) to h's counts, taking each
+// bucket's values to be its midpoint.
+//
+
+void stream_histogram(Stream *st, double scale, Histogram *h)
+{
+    if (st->counts == NULL)
+        return;
+    for (int i = 0; i < STREAM_BUCKETS; i += 1) {
+        if (st->counts[i] == 0)
+            continue;
+        uint64_t v = stream_bucket_mid(i);
+        if (v < st->min)
+            v = st->min;
+        if (v > st->max)
+            v = st->max;
+        h->counts[histogram_bin(h, v * scale)] += st->counts[i];
+    }
+}
+
+
+
+//
+// Calculate the summary statistics of metric m from st. Times are converted
+// to seconds; the median is an estimate (see above).
+//
+
+void stream_summarise(Conf *conf, Stream *st, enum Metric m, Summary *s)
+{
+    double scale = metric_scales[m];
+    uint64_t n = st->n;
+
+    // Every run may have failed or timed out.
+    if (n == 0) {
+        s->mean = s->ci = s->stddev = s->min = s->median = s->max = NAN;
+        return;
+    }
+
+    s->mean = st->mean * scale;
+    s->stddev = sqrt(st->m2 / n) * scale;
+    s->ci = z_t(conf, n > 30 ? 30 : n) * s->stddev / sqrt(n);
+    s->min = st->min * scale;
+    s->max = st->max * scale;
+    if (n % 2 == 0)
+        s->median = ((double) stream_rank(st, n / 2)
+          + stream_rank(st, n / 2 + 1)) / 2 * scale;
+    else
+        s->median = stream_rank(st, n / 2 + 1) * scale;
+}
+
+
+
+//
+// Return the index of the bucket v falls into.
+//
+
+int stream_bucket(uint64_t v)
+{
+    if (v < 2 * STREAM_SUB)
+        return v;
+
+    int shift = 63 - __builtin_clzll(v) - STREAM_SUB_BITS;
+    return STREAM_SUB * (shift + 1) + (int) (v >> shift) - STREAM_SUB;
+}
+
+
+
+//
+// Return the midpoint of bucket i.
+//
+
+uint64_t stream_bucket_mid(int i)
+{
+    if (i < 2 * STREAM_SUB)
+        return i;
+
+    int shift = i / STREAM_SUB - 1;
+    uint64_t lower = (uint64_t) (i % STREAM_SUB + STREAM_SUB) << shift;
+    return lower + ((UINT64_C(1) << shift) - 1) / 2;
+}
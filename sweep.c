@@ -0,0 +1,513 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Parameter sweeps.
+//
+// Each --param gives a parameter a list of values. Every command which
+// mentions {name} for some parameters is expanded into one command per
+// combination of those parameters' values, which are then run (in random
+// order) like any other commands. Afterwards, for each parameter, the
+// commands which differ only in its value are fitted against a power law
+// (time ~ value^exponent). If times fall as the value grows, the parameter is
+// taken to be a degree of parallelism, and the speedups are also fitted
+// against Amdahl's law and linear scaling.
+//
+
+#include "Config.h"
+
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "multitime.h"
+#include "format.h"
+#include "sweep.h"
+
+
+
+// The most values a single range may expand to.
+#define MAX_RANGE_VALS 10000
+
+double parse_num(const char *);
+void add_val(Param *, const char *, double);
+const char *parse_range(Param *, char *, char *);
+bool uses_param(Cmd *, Param *);
+char *subst(Conf *, int *, const char *);
+void fit(Conf *, Sweep *);
+double r_squared(double *, double *, int);
+
+
+
+
+//
+// Parse s (as given to --param) of the form name=item,...,item, where each
+// item is a value or a range lo..hi, lo..hi+step or lo..hi*factor, and add it
+// to conf->params. Returns NULL if successful or an error message otherwise.
+//
+
+const char *sweep_parse(Conf *conf, const char *s)
+{
+    const char *eq = strchr(s, '=');
+    if (eq == NULL || eq == s || eq[1] == '\0')
+        return "'param' not of the form name=values.";
+    for (const char *c = s; c < eq; c += 1) {
+        if (!isalnum((unsigned char) *c) && *c != '_')
+            return "'param' name must be alphanumeric.";
+    }
+    for (int i = 0; i < conf->num_params; i += 1) {
+        if (strlen(conf->params[i].name) == (size_t) (eq - s)
+          && strncmp(conf->params[i].name, s, eq - s) == 0)
+            return "'param' given more than once.";
+    }
+
+    conf->params = realloc(conf->params, (conf->num_params + 1)
+      * sizeof(Param));
+    char *name = strndup(s, eq - s), *vals = strdup(eq + 1);
+    if (conf->params == NULL || name == NULL || vals == NULL)
+        errx(1, "Out of memory.");
+    Param *param = &conf->params[conf->num_params++];
+    param->name = name;
+    param->vals = NULL;
+    param->nums = NULL;
+    param->num_vals = 0;
+
+    char *item = vals;
+    while (true) {
+        char *end = strchr(item, ',');
+        if (end != NULL)
+            *end = '\0';
+        if (*item == '\0')
+            return "'param' has an empty value.";
+        char *dots = strstr(item, "..");
+        if (dots != NULL) {
+            const char *msg = parse_range(param, item, dots);
+            if (msg != NULL)
+                return msg;
+        }
+        else
+            add_val(param, item, parse_num(item));
+        if (end == NULL)
+            break;
+        item = end + 1;
+    }
+    free(vals);
+
+    return NULL;
+}
+
+
+
+//
+// Return s as a number, with an optional K, M, G or T suffix multiplying it by
+// the corresponding power of 1024, or NAN if s isn't such a number.
+//
+
+double parse_num(const char *s)
+{
+    errno = 0;
+    char *ep;
+    double dval = strtod(s, &ep);
+    if (ep == s || errno == ERANGE)
+        return NAN;
+    const char *suffixes = "KMGT";
+    if (*ep != '\0') {
+        const char *sf = strchr(suffixes, toupper((unsigned char) *ep));
+        if (sf == NULL || ep[1] != '\0')
+            return NAN;
+        dval *= pow(1024, sf - suffixes + 1);
+    }
+
+    return dval;
+}
+
+
+
+//
+// Append the value val, which is num as a number, to param's values.
+//
+
+void add_val(Param *param, const char *val, double num)
+{
+    param->vals = realloc(param->vals, (param->num_vals + 1) * sizeof(char *));
+    param->nums = realloc(param->nums, (param->num_vals + 1) * sizeof(double));
+    if (param->vals == NULL || param->nums == NULL
+      || (param->vals[param->num_vals] = strdup(val)) == NULL)
+        errx(1, "Out of memory.");
+    param->nums[param->num_vals++] = num;
+}
+
+
+
+//
+// Add the values of the range item (where dots points to its "..") to param.
+// Returns NULL if successful or an error message otherwise.
+//
+
+const char *parse_range(Param *param, char *item, char *dots)
+{
+    *dots = '\0';
+    double lo = parse_num(item);
+    char *hi_s = dots + 2, *op = strpbrk(hi_s, "+*");
+    char opc = '+';
+    double step = 1;
+    if (op != NULL) {
+        opc = *op;
+        *op = '\0';
+        step = parse_num(op + 1);
+    }
+    double hi = parse_num(hi_s);
+    if (isnan(lo) || isnan(hi) || isnan(step))
+        return "'param' range not a valid range of numbers.";
+    if (lo > hi || (opc == '+' && step <= 0) || (opc == '*'
+      && (step <= 1 || lo <= 0)))
+        return "'param' range out of range.";
+
+    int n = 0;
+    // Allow for a little rounding error in the last value.
+    for (double v = lo; v <= hi * (1 + 1e-9); v = opc == '+' ? v + step
+      : v * step) {
+        if (++n > MAX_RANGE_VALS)
+            return "'param' range has too many values.";
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.15g", v);
+        add_val(param, buf, v);
+    }
+
+    return NULL;
+}
+
+
+
+//
+// Expand every command in conf which mentions any parameter into one command
+// per combination of the values of the parameters it mentions. Each expanded
+// command's argv, -r, -i and -o commands have {name} replaced by the
+// corresponding value.
+//
+
+void sweep_expand(Conf *conf)
+{
+    if (conf->num_params == 0)
+        return;
+
+    bool used[conf->num_params];
+    memset(used, 0, sizeof(used));
+    int num_cmds = 0;
+    Cmd **cmds = NULL;
+    for (int i = 0; i < conf->num_cmds; i += 1) {
+        Cmd *orig = conf->cmds[i];
+        int vals[conf->num_params];
+        int num_combs = 1;
+        bool swept = false;
+        for (int j = 0; j < conf->num_params; j += 1) {
+            if (uses_param(orig, &conf->params[j])) {
+                vals[j] = 0;
+                if (num_combs > INT_MAX / conf->params[j].num_vals)
+                    errx(1, "Too many combinations of parameters.");
+                num_combs *= conf->params[j].num_vals;
+                used[j] = swept = true;
+            }
+            else
+                vals[j] = -1;
+        }
+        if (!swept) {
+            cmds = realloc(cmds, (num_cmds + 1) * sizeof(Cmd *));
+            if (cmds == NULL)
+                errx(1, "Out of memory.");
+            cmds[num_cmds++] = orig;
+            continue;
+        }
+
+        cmds = realloc(cmds, (num_cmds + num_combs) * sizeof(Cmd *));
+        if (cmds == NULL)
+            errx(1, "Out of memory.");
+        for (int k = 0; k < num_combs; k += 1) {
+            Cmd *cmd = malloc(sizeof(Cmd));
+            int argc = 0;
+            while (orig->argv[argc] != NULL)
+                argc += 1;
+            if (cmd == NULL
+              || (cmd->argv = malloc((argc + 1) * sizeof(char *))) == NULL
+              || (cmd->param_vals = malloc(sizeof(vals))) == NULL)
+                errx(1, "Out of memory.");
+            char **argv = cmd->argv;
+            int *param_vals = cmd->param_vals;
+            *cmd = *orig;
+            cmd->argv = argv;
+            cmd->param_vals = param_vals;
+            memmove(cmd->param_vals, vals, sizeof(vals));
+            cmd->origin = i;
+            for (int j = 0; j < argc; j += 1)
+                cmd->argv[j] = subst(conf, vals, orig->argv[j]);
+            cmd->argv[argc] = NULL;
+            cmd->pre_cmd = subst(conf, vals, orig->pre_cmd);
+            cmd->input_cmd = subst(conf, vals, orig->input_cmd);
+            cmd->output_cmd = subst(conf, vals, orig->output_cmd);
+            cmds[num_cmds++] = cmd;
+
+            // Move on to the next combination, the last parameter varying
+            // fastest.
+            for (int j = conf->num_params - 1; j >= 0; j -= 1) {
+                if (vals[j] == -1)
+                    continue;
+                if (++vals[j] < conf->params[j].num_vals)
+                    break;
+                vals[j] = 0;
+            }
+        }
+    }
+
+    for (int j = 0; j < conf->num_params; j += 1) {
+        if (!used[j])
+            errx(1, "No command uses the parameter '{%s}'.",
+              conf->params[j].name);
+    }
+
+    conf->cmds = cmds;
+    conf->num_cmds = num_cmds;
+}
+
+
+
+//
+// Return true if any of cmd's arguments, or its -r, -i or -o commands,
+// mention param.
+//
+
+bool uses_param(Cmd *cmd, Param *param)
+{
+    char ph[strlen(param->name) + 3];
+    snprintf(ph, sizeof(ph), "{%s}", param->name);
+    for (int i = 0; cmd->argv[i] != NULL; i += 1) {
+        if (strstr(cmd->argv[i], ph) != NULL)
+            return true;
+    }
+    const char *cmds[] = {cmd->pre_cmd, cmd->input_cmd, cmd->output_cmd};
+    for (int i = 0; i < 3; i += 1) {
+        if (cmds[i] != NULL && strstr(cmds[i], ph) != NULL)
+            return true;
+    }
+
+    return false;
+}
+
+
+
+//
+// Return a copy of s with each {name} replaced by the value vals gives its
+// parameter. Returns a malloc'd string unless s is NULL, whereupon NULL is
+// returned.
+//
+
+char *subst(Conf *conf, int *vals, const char *s)
+{
+    if (s == NULL)
+        return NULL;
+
+    size_t len = 0, cap = strlen(s) + 1;
+    char *rtn = malloc(cap);
+    if (rtn == NULL)
+        errx(1, "Out of memory.");
+    while (*s != '\0') {
+        const char *val = NULL;
+        size_t skip = 1;
+        if (*s == '{') {
+            for (int i = 0; i < conf->num_params; i += 1) {
+                size_t nl = strlen(conf->params[i].name);
+                if (vals[i] != -1 && strncmp(s + 1, conf->params[i].name,
+                  nl) == 0 && s[nl + 1] == '}') {
+                    val = conf->params[i].vals[vals[i]];
+                    skip = nl + 2;
+                    break;
+                }
+            }
+        }
+        size_t vl = val == NULL ? 1 : strlen(val);
+        if (len + vl + 1 > cap) {
+            cap = (len + vl + 1) * 2;
+            if ((rtn = realloc(rtn, cap)) == NULL)
+                errx(1, "Out of memory.");
+        }
+        memmove(rtn + len, val == NULL ? s : val, vl);
+        len += vl;
+        s += skip;
+    }
+    rtn[len] = '\0';
+
+    return rtn;
+}
+
+
+
+//
+// Fit every sweep: for each parameter, every set of commands expanded from the
+// same command which differ only in that parameter's value.
+//
+
+void sweep_fit(Conf *conf)
+{
+    conf->sweeps = NULL;
+    conf->num_sweeps = 0;
+    for (int p = 0; p < conf->num_params; p += 1) {
+        Param *param = &conf->params[p];
+        if (param->num_vals < 2)
+            continue;
+        for (int i = 0; i < conf->num_cmds; i += 1) {
+            // Each sweep starts from the command with the parameter's first
+            // value.
+            Cmd *first = conf->cmds[i];
+            if (first->param_vals == NULL || first->param_vals[p] != 0)
+                continue;
+
+            conf->sweeps = realloc(conf->sweeps, (conf->num_sweeps + 1)
+              * sizeof(Sweep));
+            if (conf->sweeps == NULL)
+                errx(1, "Out of memory.");
+            Sweep *sw = &conf->sweeps[conf->num_sweeps++];
+            sw->param = p;
+            sw->cmds = malloc(param->num_vals * sizeof(Cmd *));
+            sw->means = malloc(param->num_vals * sizeof(double));
+            if (sw->cmds == NULL || sw->means == NULL)
+                errx(1, "Out of memory.");
+            for (int j = i; j < conf->num_cmds; j += 1) {
+                Cmd *cmd = conf->cmds[j];
+                if (cmd->param_vals == NULL || cmd->origin != first->origin)
+                    continue;
+                int q;
+                for (q = 0; q < conf->num_params; q += 1) {
+                    if (q != p && cmd->param_vals[q] != first->param_vals[q])
+                        break;
+                }
+                if (q == conf->num_params)
+                    sw->cmds[cmd->param_vals[p]] = cmd;
+            }
+            fit(conf, sw);
+        }
+    }
+}
+
+
+
+//
+// Fit sw's mean real times against a power law and, if they fall as the
+// parameter grows, its speedups against Amdahl's law and linear scaling.
+//
+
+void fit(Conf *conf, Sweep *sw)
+{
+    Param *param = &conf->params[sw->param];
+    int n = param->num_vals;
+    sw->parallel = false;
+    sw->exponent = sw->exponent_r2 = NAN;
+    sw->serial = sw->amdahl_r2 = sw->linear_r2 = NAN;
+
+    bool numeric = true;
+    int ref = 0;
+    double lx[n], lt[n];
+    for (int i = 0; i < n; i += 1) {
+        Summary s;
+        summarise(conf, sw->cmds[i], METRIC_REAL, &s);
+        sw->means[i] = s.mean;
+        if (!(param->nums[i] > 0) || !(s.mean > 0))
+            numeric = false;
+        else {
+            lx[i] = log(param->nums[i]);
+            lt[i] = log(s.mean);
+            if (param->nums[i] < param->nums[ref])
+                ref = i;
+        }
+    }
+    if (!numeric)
+        return;
+
+    // The power law is a straight line through log(time) against log(value).
+    double mx = 0, mt = 0;
+    for (int i = 0; i < n; i += 1) {
+        mx += lx[i] / n;
+        mt += lt[i] / n;
+    }
+    double sxx = 0, sxt = 0;
+    for (int i = 0; i < n; i += 1) {
+        sxx += (lx[i] - mx) * (lx[i] - mx);
+        sxt += (lx[i] - mx) * (lt[i] - mt);
+    }
+    if (sxx == 0)
+        return;
+    sw->exponent = sxt / sxx;
+    double pred[n];
+    for (int i = 0; i < n; i += 1)
+        pred[i] = mt + sw->exponent * (lx[i] - mx);
+    sw->exponent_r2 = r_squared(lt, pred, n);
+    if (sw->exponent >= 0)
+        return;
+    sw->parallel = true;
+
+    // Relative to the smallest value, Amdahl's law says that the speedup S at
+    // r times the parallelism satisfies 1/S = s + (1 - s)/r for a serial
+    // fraction s, i.e. 1/S - 1/r = s(1 - 1/r): a line through the origin.
+    double speedups[n], rs[n], sxy = 0, sxx2 = 0;
+    for (int i = 0; i < n; i += 1) {
+        speedups[i] = sw->means[ref] / sw->means[i];
+        rs[i] = param->nums[i] / param->nums[ref];
+        double x = 1 - 1 / rs[i];
+        sxy += x * (1 / speedups[i] - 1 / rs[i]);
+        sxx2 += x * x;
+    }
+    sw->serial = fmin(fmax(sxy / sxx2, 0), 1);
+    for (int i = 0; i < n; i += 1)
+        pred[i] = 1 / (sw->serial + (1 - sw->serial) / rs[i]);
+    sw->amdahl_r2 = r_squared(speedups, pred, n);
+    sw->linear_r2 = r_squared(speedups, rs, n);
+}
+
+
+
+//
+// Return the coefficient of determination of the n predictions pred of ys,
+// or NAN if ys are all the same.
+//
+
+double r_squared(double *ys, double *pred, int n)
+{
+    double my = 0;
+    for (int i = 0; i < n; i += 1)
+        my += ys[i] / n;
+    double ss_res = 0, ss_tot = 0;
+    for (int i = 0; i < n; i += 1) {
+        ss_res += (ys[i] - pred[i]) * (ys[i] - pred[i]);
+        ss_tot += (ys[i] - my) * (ys[i] - my);
+    }
+    if (ss_tot == 0)
+        return NAN;
+
+    return 1 - ss_res / ss_tot;
+}
@@ -0,0 +1,548 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Waiting between runs.
+//
+// By default, multitime pauses for a random time of up to conf->sleep seconds
+// between runs. That wastes time when the system settles quickly, and may not
+// be long enough when it doesn't. With --wait quiesce, we instead poll the
+// state of the system until it is back to the baseline measured before the
+// first run, giving up after conf->sleep seconds. The system is considered
+// quiescent when:
+//
+//   * the proportion of non-idle CPU time (from /proc/stat) since the last
+//     poll is no more than CPU_SLACK above the baseline;
+//   * no more tasks are runnable (from /proc/loadavg) than in the baseline;
+//   * no more than DIRTY_SLACK kB more memory is dirty or under writeback
+//     (from /proc/meminfo) than in the baseline;
+//   * the hottest thermal zone (from /sys/class/thermal), if there are any, is
+//     no more than TEMP_SLACK millidegrees hotter than in the baseline.
+//
+// The load averages in /proc/loadavg decay over minutes, far too slowly to
+// wait on between runs, so only its count of runnable tasks is used.
+//
+// With --noise, the system is also snapshotted immediately before each run
+// is launched and after it is reaped, so that activity elsewhere on the
+// machine during the run can be recorded alongside it: the CPU time used by
+// other processes, interrupts, paging, pressure stall (PSI) time, and CPU
+// frequency. The run's noise score is the largest of the percentage of the
+// machine's CPU time used by other processes and the percentages of the run
+// during which some task stalled on CPU, memory or I/O. /proc/stat only
+// counts CPU time in clock ticks, so one tick per CPU is allowed for
+// rounding before other processes are blamed.
+//
+
+#include "Config.h"
+
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "multitime.h"
+#include "schedule.h"
+#include "sysmon.h"
+
+
+
+// Milliseconds between polls of the system's state.
+#define POLL_MS 50
+// How many polls the baseline is measured over.
+#define BASELINE_POLLS 5
+#define CPU_SLACK 0.05
+#define DIRTY_SLACK 4096
+#define TEMP_SLACK 2000
+
+const char *wait_names[] = {"random", "quiesce", NULL};
+
+// The pressure stall information files, indexed as Snapshot's psi.
+static const char *psi_files[] = {"/proc/pressure/cpu",
+  "/proc/pressure/memory", "/proc/pressure/io", NULL};
+
+// A snapshot of the system's state. snapshot fills in everything up to temp;
+// noise_snapshot fills in busy, total and everything from intr.
+typedef struct {
+    uint64_t busy, total;       // Jiffies of non-idle and all CPU time.
+    int runnable;               // Runnable tasks (including us).
+    int64_t dirty;              // kB of memory dirty or under writeback.
+    int64_t temp;               // Millidegrees C of the hottest thermal
+                                // zone. -1 = no thermal zones.
+    uint64_t intr;              // Interrupts serviced.
+    uint64_t paging;            // Major faults, swap-ins and swap-outs.
+    uint64_t psi[3];            // us during which some task stalled on CPU,
+                                // memory and I/O. 0 = no PSI.
+    int64_t khz;                // Mean current CPU frequency. 0 = unknown.
+} Snapshot;
+
+// The baseline: the mean proportion of non-idle CPU time and the highest of
+// the other measurements over BASELINE_POLLS polls.
+static double base_cpu;
+static Snapshot base;
+
+// The snapshots either side of the executing run (--noise only, which
+// requires runs to be executed one at a time).
+static Snapshot noise_pre, noise_post;
+static long num_cpus, max_cpus, ticks_per_sec;
+
+void snapshot(Snapshot *);
+void noise_snapshot(Snapshot *);
+bool read_cpu(Snapshot *);
+uint64_t read_intr(void);
+uint64_t read_paging(void);
+uint64_t read_psi(const char *);
+int64_t read_khz(void);
+bool read_runnable(Snapshot *);
+bool read_dirty(Snapshot *);
+int64_t read_temp(void);
+double cpu_busy(Snapshot *, Snapshot *);
+void sleep_ns(uint64_t);
+double now_secs(void);
+
+
+
+
+//
+// Measure the baseline state of the system, before any runs have been
+// started. Must be called before sysmon_pause if conf->wait is WAIT_QUIESCE.
+//
+
+void sysmon_init(Conf *conf)
+{
+    conf->num_waits = conf->num_capped_waits = 0;
+    conf->waited = 0;
+    if (conf->wait != WAIT_QUIESCE)
+        return;
+
+    Snapshot prev, cur;
+    snapshot(&prev);
+    base = prev;
+    base_cpu = 0;
+    for (int i = 0; i < BASELINE_POLLS; i += 1) {
+        sleep_ns(POLL_MS * 1000000);
+        snapshot(&cur);
+        base_cpu += cpu_busy(&prev, &cur) / BASELINE_POLLS;
+        if (cur.runnable > base.runnable)
+            base.runnable = cur.runnable;
+        if (cur.dirty > base.dirty)
+            base.dirty = cur.dirty;
+        if (cur.temp > base.temp)
+            base.temp = cur.temp;
+        prev = cur;
+    }
+
+    if (conf->verbosity > 0) {
+        fprintf(stderr, "===> Baseline: %.1f%% CPU busy, %d runnable, %" PRId64
+          "kB dirty", base_cpu * 100, base.runnable, base.dirty);
+        if (base.temp != -1)
+            fprintf(stderr, ", %.1fC", base.temp / 1000.0);
+        fprintf(stderr, "\n");
+    }
+}
+
+
+
+//
+// Pause between two runs, either for a random time of up to conf->sleep
+// seconds or, with --wait quiesce, until the system is quiescent.
+//
+
+void sysmon_pause(Conf *conf)
+{
+    uint64_t max_ns = (uint64_t) (conf->sleep * 1000000000);
+    if (conf->wait == WAIT_RANDOM) {
+        if (max_ns > 0)
+            sleep_ns(schedule_randn(conf, max_ns));
+        return;
+    }
+
+    double start = now_secs();
+    Snapshot prev, cur;
+    snapshot(&prev);
+    bool quiet = false;
+    while (!quiet) {
+        double waited = now_secs() - start;
+        if (waited >= conf->sleep)
+            break;
+        uint64_t left_ns = (uint64_t) ((conf->sleep - waited) * 1000000000);
+        sleep_ns(left_ns < POLL_MS * 1000000 ? left_ns : POLL_MS * 1000000);
+        snapshot(&cur);
+        quiet = cpu_busy(&prev, &cur) <= base_cpu + CPU_SLACK
+          && cur.runnable <= base.runnable
+          && cur.dirty <= base.dirty + DIRTY_SLACK
+          && cur.temp <= base.temp + TEMP_SLACK;
+        prev = cur;
+    }
+
+    double waited = now_secs() - start;
+    conf->num_waits += 1;
+    conf->waited += waited;
+    if (!quiet)
+        conf->num_capped_waits += 1;
+    if (conf->verbosity > 0)
+        fprintf(stderr, "===> Waited %.3fs%s\n", waited,
+          quiet ? " for the system to quiesce" : " (the system did not quiesce)");
+}
+
+
+
+//
+// Check that the system's noise can be monitored. Must be called before any
+// run is started with --noise.
+//
+
+void sysmon_noise_probe(Conf *conf)
+{
+    num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    max_cpus = sysconf(_SC_NPROCESSORS_CONF);
+    ticks_per_sec = sysconf(_SC_CLK_TCK);
+    if (num_cpus < 1 || ticks_per_sec < 1)
+        errx(1, "Can't determine the number of CPUs or the clock tick rate.");
+    noise_snapshot(&noise_pre);
+    if (conf->verbosity > 0 && noise_pre.psi[0] == 0)
+        fprintf(stderr, "===> Pressure stall information isn't available\n");
+}
+
+
+
+//
+// Snapshot the system just before a run is launched.
+//
+
+void sysmon_noise_start(void)
+{
+    noise_snapshot(&noise_pre);
+}
+
+
+
+//
+// Snapshot the system just after a run has been reaped.
+//
+
+void sysmon_noise_finish(void)
+{
+    noise_snapshot(&noise_post);
+}
+
+
+
+//
+// Calculate the noise metrics of the run which has just finished into vals
+// (which must have NUM_METRICS elements, with the rusage metrics already
+// filled in).
+//
+
+void sysmon_noise_read(int64_t *vals)
+{
+    double real = vals[METRIC_REAL] / 1e9;
+    if (real <= 0)
+        real = 1e-9;
+
+    double tick = 1.0 / ticks_per_sec;
+    double other = (noise_post.busy - noise_pre.busy) * tick
+      - (vals[METRIC_USER] + vals[METRIC_SYS]) / 1e9 - num_cpus * tick;
+    double other_pc = other > 0 ? 100 * other / (real * num_cpus) : 0;
+    double noise = other_pc;
+    vals[METRIC_OTHER_CPU] = llround(other_pc * 100);
+
+    for (int i = 0; psi_files[i] != NULL; i += 1) {
+        double stall_pc = (noise_post.psi[i] - noise_pre.psi[i]) / 1e6 / real
+          * 100;
+        if (stall_pc > 100)
+            stall_pc = 100;
+        vals[METRIC_PSI_CPU + i] = llround(stall_pc * 100);
+        if (stall_pc > noise)
+            noise = stall_pc;
+    }
+    vals[METRIC_NOISE] = llround(noise * 100);
+
+    vals[METRIC_INTERRUPTS] = noise_post.intr - noise_pre.intr;
+    int64_t paging = noise_post.paging - noise_pre.paging
+      - vals[METRIC_MAJFLT];
+    vals[METRIC_PAGING] = paging > 0 ? paging : 0;
+    vals[METRIC_CPU_MHZ] = (noise_pre.khz + noise_post.khz) / 2000;
+}
+
+
+
+//
+// Take a snapshot of the system's state into s.
+//
+
+void snapshot(Snapshot *s)
+{
+    if (!read_cpu(s) || !read_runnable(s) || !read_dirty(s))
+        errx(1, "--wait quiesce needs /proc/stat, /proc/loadavg and "
+          "/proc/meminfo.");
+    s->temp = read_temp();
+}
+
+
+
+//
+// Take a snapshot of the system activity which is attributed to noise into s.
+//
+
+void noise_snapshot(Snapshot *s)
+{
+    if (!read_cpu(s))
+        errx(1, "--noise needs /proc/stat.");
+    s->intr = read_intr();
+    s->paging = read_paging();
+    for (int i = 0; psi_files[i] != NULL; i += 1)
+        s->psi[i] = read_psi(psi_files[i]);
+    s->khz = read_khz();
+}
+
+
+
+bool read_cpu(Snapshot *s)
+{
+    FILE *f = fopen("/proc/stat", "re");
+    if (f == NULL)
+        return false;
+    // user, nice, system, idle, iowait, irq, softirq, steal.
+    unsigned long long v[8];
+    int n = fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu", &v[0],
+      &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]);
+    fclose(f);
+    if (n < 4)
+        return false;
+    s->total = 0;
+    for (int i = 0; i < n; i += 1)
+        s->total += v[i];
+    s->busy = s->total - v[3] - (n > 4 ? v[4] : 0);
+
+    return true;
+}
+
+
+
+bool read_runnable(Snapshot *s)
+{
+    FILE *f = fopen("/proc/loadavg", "re");
+    if (f == NULL)
+        return false;
+    int n = fscanf(f, "%*f %*f %*f %d/", &s->runnable);
+    fclose(f);
+
+    return n == 1;
+}
+
+
+
+bool read_dirty(Snapshot *s)
+{
+    FILE *f = fopen("/proc/meminfo", "re");
+    if (f == NULL)
+        return false;
+    char line[256];
+    int found = 0;
+    s->dirty = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        intmax_t kb;
+        if (sscanf(line, "Dirty: %jd kB", &kb) == 1
+          || sscanf(line, "Writeback: %jd kB", &kb) == 1) {
+            s->dirty += kb;
+            found += 1;
+        }
+    }
+    fclose(f);
+
+    return found == 2;
+}
+
+
+
+//
+// Return the number of interrupts serviced since boot, or 0 if unknown.
+//
+
+uint64_t read_intr(void)
+{
+    FILE *f = fopen("/proc/stat", "re");
+    if (f == NULL)
+        return 0;
+    // The "intr" line can be very long, so only its start is of interest.
+    char buf[256];
+    unsigned long long intr = 0;
+    bool line_start = true;
+    while (fgets(buf, sizeof(buf), f) != NULL) {
+        if (line_start && sscanf(buf, "intr %llu", &intr) == 1)
+            break;
+        line_start = strchr(buf, '\n') != NULL;
+    }
+    fclose(f);
+
+    return intr;
+}
+
+
+
+//
+// Return the number of major page faults, swap-ins and swap-outs since boot.
+//
+
+uint64_t read_paging(void)
+{
+    FILE *f = fopen("/proc/vmstat", "re");
+    if (f == NULL)
+        return 0;
+    char name[64];
+    unsigned long long val, paging = 0;
+    while (fscanf(f, "%63s %llu", name, &val) == 2) {
+        if (strcmp(name, "pgmajfault") == 0 || strcmp(name, "pswpin") == 0
+          || strcmp(name, "pswpout") == 0)
+            paging += val;
+    }
+    fclose(f);
+
+    return paging;
+}
+
+
+
+//
+// Return the total time, in us, during which some task stalled according to
+// the pressure stall information file path, or 0 if it can't be read.
+//
+
+uint64_t read_psi(const char *path)
+{
+    FILE *f = fopen(path, "re");
+    if (f == NULL)
+        return 0;
+    unsigned long long total = 0;
+    if (fscanf(f, "some avg10=%*f avg60=%*f avg300=%*f total=%llu", &total) != 1)
+        total = 0;
+    fclose(f);
+
+    return total;
+}
+
+
+
+//
+// Return the mean current frequency, in kHz, of the CPUs, or 0 if unknown.
+//
+
+int64_t read_khz(void)
+{
+    int64_t sum = 0;
+    int n = 0;
+    for (long cpu = 0; cpu < max_cpus; cpu += 1) {
+        char path[128];
+        snprintf(path, sizeof(path),
+          "/sys/devices/system/cpu/cpu%ld/cpufreq/scaling_cur_freq", cpu);
+        FILE *f = fopen(path, "re");
+        if (f == NULL)
+            continue;
+        intmax_t khz;
+        if (fscanf(f, "%jd", &khz) == 1) {
+            sum += khz;
+            n += 1;
+        }
+        fclose(f);
+    }
+
+    return n > 0 ? sum / n : 0;
+}
+
+
+
+//
+// Return the temperature, in millidegrees C, of the hottest thermal zone, or
+// -1 if there are none.
+//
+
+int64_t read_temp(void)
+{
+    DIR *d = opendir("/sys/class/thermal");
+    if (d == NULL)
+        return -1;
+    int64_t hottest = -1;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (strncmp(e->d_name, "thermal_zone", 12) != 0)
+            continue;
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "/sys/class/thermal/%s/temp", e->d_name);
+        FILE *f = fopen(path, "re");
+        if (f == NULL)
+            continue;
+        intmax_t temp;
+        if (fscanf(f, "%jd", &temp) == 1 && temp > hottest)
+            hottest = temp;
+        fclose(f);
+    }
+    closedir(d);
+
+    return hottest;
+}
+
+
+
+//
+// Return the proportion of CPU time which was not idle between snapshots
+// prev and cur.
+//
+
+double cpu_busy(Snapshot *prev, Snapshot *cur)
+{
+    if (cur->total <= prev->total)
+        return 0;
+    return (double) (cur->busy - prev->busy) / (cur->total - prev->total);
+}
+
+
+
+//
+// Sleep for ns nanoseconds, resuming if interrupted by a signal.
+//
+
+void sleep_ns(uint64_t ns)
+{
+    struct timespec ts = {.tv_sec = ns / 1000000000,
+      .tv_nsec = ns % 1000000000};
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+        continue;
+}
+
+
+
+double now_secs(void)
+{
+    struct timespec ts;
+    clock_gettime(MT_CLOCK, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,348 @@
+// Copyright (C)2008-2012 Laurence Tratt http://tratt.net/laurie/
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+//
+// Timeouts and censored runs.
+//
+// A run which exceeds its command's timeout is sent SIGTERM and, if it still
+// hasn't exited KILL_GRACE seconds later, SIGKILL. Runs with a timeout are put
+// in their own process group (see isolate.c), and the signals are sent to the
+// whole group, so that processes the command started don't outlive it. With
+// --cgroup, SIGKILL is also sent to the run's whole cgroup, catching any
+// process which left the group. The signals are sent from a
+// SIGALRM handler, with a single interval timer set to the earliest deadline
+// of any executing run, so that nothing else has to stop blocking in wait4.
+// The handler is installed with SA_RESTART, so interrupted waits simply
+// resume. A run stops being signalled the moment it is reaped (see
+// timeout_wait4), as its pid may then be reused.
+//
+// A timed out run's real time is only known to be longer than the timeout:
+// it is "censored". Such runs are left out of the usual statistics, which
+// would otherwise be biased towards fast runs, and the Kaplan-Meier estimator
+// is used instead to estimate the median and (restricted) mean real time
+// from both finished and censored runs.
+//
+
+#include "Config.h"
+
+#include <err.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "multitime.h"
+#include "timeout.h"
+
+
+
+// Seconds between SIGTERM and SIGKILL.
+#define KILL_GRACE 1
+
+const char *state_names[] = {"ok", "failed", "timed_out", NULL};
+
+// The runs with a timeout which are currently executing. Only changed with
+// SIGALRM blocked, so that the handler always sees a consistent set.
+static Run **timed_runs;
+static int num_timed_runs;
+
+void timeout_alarm(int);
+void timeout_kill(Run *, int);
+void timeout_arm(int64_t);
+int64_t timeout_now(void);
+int cmp_censored(const void *, const void *);
+
+
+
+
+//
+// Install the SIGALRM handler. Must be called before any run is started with a
+// timeout.
+//
+
+void timeout_init(Conf *conf)
+{
+    int max_runs = conf->jobs + 1;
+    if ((timed_runs = malloc(max_runs * sizeof(Run *))) == NULL)
+        errx(1, "Out of memory.");
+    num_timed_runs = 0;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = timeout_alarm;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGALRM, &sa, NULL) == -1)
+        err(1, "Can't install SIGALRM handler");
+}
+
+
+
+//
+// Start timing out run (which has just been launched) if its command has a
+// timeout.
+//
+
+void timeout_start(Run *run)
+{
+    run->timeout_stage = 0;
+    if (run->cmd->iso.timeout == 0)
+        return;
+
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    sigprocmask(SIG_BLOCK, &set, &old);
+    run->deadline = run->startt.tv_sec * (int64_t) 1000000000
+      + run->startt.tv_nsec + (int64_t) (run->cmd->iso.timeout * 1000000000);
+    timed_runs[num_timed_runs++] = run;
+    timeout_arm(timeout_now());
+    sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+
+
+//
+// As wait4, except that a run with a timeout stops being timed out as it is
+// reaped. The child is first waited for without being reaped, so that its pid
+// can't be reused while SIGALRM may still be delivered for it; it is then
+// reaped with SIGALRM blocked.
+//
+
+pid_t timeout_wait4(pid_t pid, int *status, int options, struct rusage *ru)
+{
+    if (timed_runs == NULL)
+        return wait4(pid, status, options, ru);
+
+    siginfo_t si;
+    si.si_pid = 0;
+    if (waitid(pid == -1 ? P_ALL : P_PID, pid == -1 ? 0 : (id_t) pid, &si,
+      WEXITED | WNOWAIT | options) == -1)
+        return -1;
+    if (si.si_pid == 0)
+        return 0;
+
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    sigprocmask(SIG_BLOCK, &set, &old);
+    pid_t rtn = wait4(si.si_pid, status, 0, ru);
+    for (int i = 0; i < num_timed_runs; i += 1) {
+        if (timed_runs[i]->pid == si.si_pid) {
+            timed_runs[i] = timed_runs[--num_timed_runs];
+            break;
+        }
+    }
+    timeout_arm(timeout_now());
+    sigprocmask(SIG_SETMASK, &old, NULL);
+
+    return rtn;
+}
+
+
+
+//
+// Return true if run, which has been reaped by timeout_wait4, was timed out.
+//
+
+bool timeout_finish(Run *run)
+{
+    return run->cmd->iso.timeout > 0 && run->timeout_stage > 0;
+}
+
+
+
+//
+// The SIGALRM handler: signal every run whose deadline has passed, and rearm
+// the timer. Only async-signal-safe functions may be called.
+//
+
+void timeout_alarm(int sig)
+{
+    (void) sig;
+    int64_t now = timeout_now();
+    for (int i = 0; i < num_timed_runs; i += 1) {
+        Run *run = timed_runs[i];
+        if (run->timeout_stage == 2 || run->deadline > now)
+            continue;
+        if (run->timeout_stage == 0) {
+            timeout_kill(run, SIGTERM);
+            run->deadline = now + KILL_GRACE * (int64_t) 1000000000;
+        }
+        else
+            timeout_kill(run, SIGKILL);
+        run->timeout_stage += 1;
+    }
+    timeout_arm(now);
+}
+
+
+
+//
+// Send sig to run's process group and, for SIGKILL, its cgroup. Called from
+// the SIGALRM handler, so only async-signal-safe functions may be called.
+//
+
+void timeout_kill(Run *run, int sig)
+{
+    // The child may not have made its process group yet (the fork engine
+    // doesn't wait for it to), in which case it's signalled on its own.
+    if (kill(-run->pid, sig) == -1)
+        kill(run->pid, sig);
+
+    if (sig == SIGKILL && run->cgroup != NULL) {
+        int dfd = open(run->cgroup, O_RDONLY | O_DIRECTORY);
+        if (dfd == -1)
+            return;
+        // cgroup.kill only exists from Linux 5.14.
+        int fd = openat(dfd, "cgroup.kill", O_WRONLY);
+        if (fd != -1) {
+            ssize_t r = write(fd, "1", 1);
+            (void) r;
+            close(fd);
+        }
+        close(dfd);
+    }
+}
+
+
+
+//
+// Set the timer to go off at the earliest deadline of any run still to be
+// signalled, or disarm it if there is none.
+//
+
+void timeout_arm(int64_t now)
+{
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < num_timed_runs; i += 1) {
+        if (timed_runs[i]->timeout_stage < 2 && timed_runs[i]->deadline < next)
+            next = timed_runs[i]->deadline;
+    }
+
+    struct itimerval it;
+    memset(&it, 0, sizeof(it));
+    if (next != INT64_MAX) {
+        // A zero timer would disarm it, so never aim for less than 1us.
+        int64_t us = next > now ? (next - now + 999) / 1000 : 1;
+        it.it_value.tv_sec = us / 1000000;
+        it.it_value.tv_usec = us % 1000000;
+    }
+    setitimer(ITIMER_REAL, &it, NULL);
+}
+
+
+
+int64_t timeout_now(void)
+{
+    struct timespec ts;
+    clock_gettime(MT_CLOCK, &ts);
+    return ts.tv_sec * (int64_t) 1000000000 + ts.tv_nsec;
+}
+
+
+
+//
+// True if runs may fail or time out without stopping multitime, so that their
+// states need reporting.
+//
+
+bool timeout_reported(Conf *conf)
+{
+    if (conf->keep_going)
+        return true;
+    for (int i = 0; i < conf->num_cmds; i += 1) {
+        if (conf->cmds[i]->iso.timeout > 0)
+            return true;
+    }
+
+    return false;
+}
+
+
+
+//
+// Estimate the median and mean of cmd's real times with the Kaplan-Meier
+// estimator, treating timed out runs as censored at the timeout. The mean is
+// restricted to the longest time observed, as the estimated survival curve
+// says nothing beyond it. Failed runs are left out.
+//
+
+void timeout_km(Cmd *cmd, Survival *sv)
+{
+    // Each observation is a time in ns and whether it is censored, sorted by
+    // time with finished runs before censored ones at the same time.
+    int64_t (*obs)[2] = malloc((cmd->num_runs + 1) * sizeof(*obs));
+    if (obs == NULL)
+        errx(1, "Out of memory.");
+    int n = 0;
+    for (int i = 0; i < cmd->num_runs; i += 1) {
+        if (cmd->states[i] == STATE_FAILED)
+            continue;
+        obs[n][0] = cmd->samples[METRIC_REAL][i];
+        obs[n][1] = cmd->states[i] == STATE_TIMED_OUT;
+        n += 1;
+    }
+    qsort(obs, n, sizeof(*obs), cmp_censored);
+
+    sv->median = NAN;
+    sv->rmean = 0;
+    sv->limit = n > 0 ? obs[n - 1][0] / 1e9 : 0;
+    double surv = 1, prev = 0;
+    int at_risk = n;
+    for (int i = 0; i < n; ) {
+        // All the runs which finished at this time leave together.
+        int64_t t = obs[i][0];
+        int events = 0, leaving = 0;
+        while (i + leaving < n && obs[i + leaving][0] == t) {
+            if (!obs[i + leaving][1])
+                events += 1;
+            leaving += 1;
+        }
+        sv->rmean += surv * (t / 1e9 - prev);
+        prev = t / 1e9;
+        surv *= 1 - (double) events / at_risk;
+        if (isnan(sv->median) && surv <= 0.5)
+            sv->median = t / 1e9;
+        at_risk -= leaving;
+        i += leaving;
+    }
+    free(obs);
+}
+
+
+
+int cmp_censored(const void *x, const void *y)
+{
+    const int64_t *a = x, *b = y;
+    if (a[0] != b[0])
+        return a[0] < b[0] ? -1 : 1;
+    return (int) (a[1] - b[1]);
+}